@@ -18,10 +18,12 @@
 
 // local:
 #include "BaseLatticeGas.h"
+#include "ByteVector.h"
 
 // standard library:
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
 
 // STL:
 #include <algorithm>
@@ -30,6 +32,25 @@
 #include <stdexcept>
 using namespace std;
 
+// the number of bits set in x
+static inline int PopCount(uint64_t x)
+{
+#if defined(__GNUC__)
+    return __builtin_popcountll(x);
+#else
+    x = x - ((x>>1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x>>2) & 0x3333333333333333ULL);
+    x = (x + (x>>4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (int)((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+BaseLatticeGas::BaseLatticeGas() : current_buffer(0), old_buffer(1), random(rand()), 
+    temporal_tile_rows(0), temporal_time_steps(1), in_place(false), tile_flags_iteration(-1), 
+    particle_bits(0), need_find_boundary_links(true), n_changes(0)
+{
+}
+
 void BaseLatticeGas::ResizeGrid(int x_size,int y_size)
 {
     this->iterations = 0;
@@ -38,9 +59,23 @@ void BaseLatticeGas::ResizeGrid(int x_size,int y_size)
 
     this->X = x_size;
     this->Y = y_size;
-    this->grid[0].assign(X,vector<state>(Y));
-    this->grid[1].assign(X,vector<state>(Y));
+    this->grid[0].Resize(X,Y,GetHaloWidth());
+    if(this->in_place)
+        this->grid[1].Resize(0,0,0);
+    else
+        this->grid[1].Resize(X,Y,GetHaloWidth());
+
+    const int n_tiles = (X+TILE-1)/TILE;
+    this->tile_flags[0].assign(Y*n_tiles,0);
+    this->tile_flags[1].assign(Y*n_tiles,0);
+    this->tile_flags_iteration = -1; // (the grid needs classifying)
+
+    this->obstacles.assign(Y*n_tiles,0);
+    this->boundary_links.clear();
+    this->first_boundary_link.assign(Y+1,0);
+    this->need_find_boundary_links = true;
 
+    FillStateTables();
     ResizeFlowSamples();
 }
 
@@ -52,7 +87,7 @@ void BaseLatticeGas::ResizeFlowSamples()
     this->averaged_velocity.assign(X/this->flow_sample_separation,
         vector<RealPoint >(Y/this->flow_sample_separation,RealPoint(0.0,0.0)));
     this->have_taken_first_velocity_average = false;
-    this->need_redraw_images = true;
+    this->n_changes++;
     this->need_recompute_flow = true;
 }
 
@@ -60,32 +95,96 @@ void BaseLatticeGas::ComputeFlow()
 {
     // recompute the locally-averaged velocities
     const int R = this->averaging_radius;
+    const int S = this->flow_sample_separation;
     const double avF=0.95; // for a running average we take a weighted mix of the previous average and the new value
 
-    this->global_mean_velocity = RealPoint(0.0,0.0);
-    int global_n_particles=0;
+    // The flow at each sample point comes from the total momentum and number of particles in the window
+    // of cells around it, which we get from summed-area tables: entry x,y of a table is the total over
+    // the cells above and to the left of x,y, so the total over a window is the sum of its four corners 
+    // (two of them subtracted). Only the rows of the tables at the top and bottom edges of the windows 
+    // are ever needed, so those are the only ones we keep.
+    vector<int> table_row(Y+1,-1); // which of the rows we keep is row y of the tables, if any
+    vector<int> rows; // the rows we keep, in order
+    table_row[0] = 0;
+    for(int y=S;y<(Y-S);y+=S)
+    {
+        table_row[max(0,y-R)] = 0;
+        table_row[min(Y-1,y+R)+1] = 0;
+    }
+    for(int y=0;y<=Y;y++)
+    {
+        if(table_row[y]<0) continue;
+        table_row[y] = (int)rows.size();
+        rows.push_back(y);
+    }
+    const int W = X+1; // (the tables have a column on the left, of zeros)
+    vector<RealPoint> momentum_table(rows.size()*W);
+    vector<int> n_particles_table(rows.size()*W);
 
-    #pragma omp parallel for
-    for(int x=this->flow_sample_separation;x<(X-this->flow_sample_separation);x+=this->flow_sample_separation)
+    // first each row of the tables gets the totals of the cells between it and the row before, from
+    // the row totals of those cells - this is O(N), and spread across the threads
+    #pragma omp parallel
     {
-        for(int y=this->flow_sample_separation;y<(Y-this->flow_sample_separation);y+=this->flow_sample_separation)
+        vector<state> buffer(X);
+        vector<RealPoint> row_velocity(X);
+        vector<int> row_n_particles(X);
+
+        #pragma omp for schedule(dynamic)
+        for(int i=1;i<(int)rows.size();i++)
         {
-            RealPoint v(0,0);
-            int n_counted = 0;
-            for(int dx=max(0,x-R);dx<=min(X-1,x+R);dx++) // (do we need to include an even mix of the sides of the 2x2 cells?)
+            RealPoint *momentum = &momentum_table[i*W];
+            int *n_particles = &n_particles_table[i*W];
+            for(int y=rows[i-1];y<rows[i];y++)
             {
-                for(int dy=max(0,y-R);dy<=min(Y-1,y+R);dy++)
+                const state *row = GetStateRow(y,&buffer[0]);
+                GetVelocitiesOfRow(row,y,X,&row_velocity[0]);
+                GetNumGasParticlesOfRow(row,X,&row_n_particles[0]);
+                double px=0.0,py=0.0;
+                int n=0;
+                for(int x=0;x<X;x++)
                 {
-                    v += GetVelocityAt(dx,dy);
-                    n_counted += GetNumGasParticlesAt(dx,dy);
+                    px += row_velocity[x].x;
+                    py += row_velocity[x].y;
+                    n += row_n_particles[x];
+                    momentum[x+1].x += px;
+                    momentum[x+1].y += py;
+                    n_particles[x+1] += n;
                 }
             }
-            int sx=x/this->flow_sample_separation,sy=y/this->flow_sample_separation;
+        }
+    }
+    // then we add up these bands down the columns
+    for(int i=1;i<(int)rows.size();i++)
+    {
+        for(int x=1;x<W;x++)
+        {
+            momentum_table[i*W+x] += momentum_table[(i-1)*W+x];
+            n_particles_table[i*W+x] += n_particles_table[(i-1)*W+x];
+        }
+    }
+
+    // (each column of sample points keeps its own totals for the global mean, so that they are added 
+    // up in the same order however the columns are shared out)
+    vector<RealPoint> column_momentum(X/S);
+    vector<int> column_n_particles(X/S);
+
+    #pragma omp parallel for
+    for(int x=S;x<(X-S);x+=S)
+    {
+        for(int y=S;y<(Y-S);y+=S)
+        {
+            // the window runs from x0,y0 to x1-1,y1-1
+            const int x0 = max(0,x-R), x1 = min(X-1,x+R)+1;
+            const int top = table_row[max(0,y-R)]*W, bottom = table_row[min(Y-1,y+R)+1]*W;
+            RealPoint v(momentum_table[bottom+x1].x - momentum_table[bottom+x0].x - momentum_table[top+x1].x + momentum_table[top+x0].x,
+                momentum_table[bottom+x1].y - momentum_table[bottom+x0].y - momentum_table[top+x1].y + momentum_table[top+x0].y);
+            int n_counted = n_particles_table[bottom+x1] - n_particles_table[bottom+x0] - n_particles_table[top+x1] + n_particles_table[top+x0];
+            int sx=x/S,sy=y/S;
             if(n_counted>0)
             {
                 velocity[sx][sy] = RealPoint(v.x / n_counted, v.y / n_counted); // av. velocity per particle
-                this->global_mean_velocity += v;
-                global_n_particles += n_counted;
+                column_momentum[sx] += v;
+                column_n_particles[sx] += n_counted;
             }
             else
                 velocity[sx][sy] = RealPoint(0.0,0.0);
@@ -104,27 +203,238 @@ void BaseLatticeGas::ComputeFlow()
     if(!this->have_taken_first_velocity_average)
         this->have_taken_first_velocity_average = true;
 
-    this->global_mean_velocity *= 1.0/global_n_particles;
+    this->global_mean_velocity = RealPoint(0.0,0.0);
+    int global_n_particles=0;
+    for(int sx=0;sx<(int)column_momentum.size();sx++)
+    {
+        this->global_mean_velocity += column_momentum[sx];
+        global_n_particles += column_n_particles[sx];
+    }
+    if(global_n_particles>0)
+        this->global_mean_velocity *= 1.0/global_n_particles;
 
     this->need_recompute_flow = false;
 }
 
+void BaseLatticeGas::ComputeFlowIfNeeded()
+{
+    if(this->need_recompute_flow)
+        ComputeFlow();
+}
+
+int BaseLatticeGas::GetFlowSampleSeparation() const
+{
+    return this->flow_sample_separation;
+}
+
+RealPoint BaseLatticeGas::GetFlow(int sx,int sy) const
+{
+    return this->velocity[sx][sy];
+}
+
+RealPoint BaseLatticeGas::GetAveragedFlow(int sx,int sy) const
+{
+    return this->averaged_velocity[sx][sy];
+}
+
+RealPoint BaseLatticeGas::GetFlowAsRepresented(int sx,int sy) const
+{
+    RealPoint v(this->velocity[sx][sy]);
+    if(this->velocity_representation == Velocity_SubtractGlobalMean)
+    {
+        // we subtract the averaged velocity at this point, to better highlight the dynamic changes
+        v.x -= this->global_mean_velocity.x;
+        v.y -= this->global_mean_velocity.y;
+    }
+    else if(this->velocity_representation == Velocity_SubtractPointMean)
+    {
+        // we subtract the averaged velocity at this point, to better highlight the dynamic changes
+        v.x -= this->averaged_velocity[sx][sy].x;
+        v.y -= this->averaged_velocity[sx][sy].y;
+    }
+    return v;
+}
+
+unsigned int BaseLatticeGas::GetNumChanges() const
+{
+    return this->n_changes;
+}
+
+Colour BaseLatticeGas::GetVectorAngleColour(float x,float y)
+{
+    // the hue goes round with the angle, at full saturation and value (as wxImage::HSVtoRGB)
+    const double hue = 6.0 * (0.5 + atan2(y,x)/(2*3.14159265358979));
+    const int sector = (int)floor(hue);
+    const double f = hue - sector;
+    double r,g,b;
+    switch(sector)
+    {
+        case 0: r=1.0; g=f; b=0.0; break;
+        case 1: r=1.0-f; g=1.0; b=0.0; break;
+        case 2: r=0.0; g=1.0; b=f; break;
+        case 3: r=0.0; g=1.0-f; b=1.0; break;
+        case 4: r=f; g=0.0; b=1.0; break;
+        default: r=1.0; g=0.0; b=1.0-f; break;
+    }
+    return Colour((unsigned char)(r*255.0),(unsigned char)(g*255.0),(unsigned char)(b*255.0));
+}
+
+Colour BaseLatticeGas::GetDensityColour(float density)
+{
+    return Colour(255*density,255*density,255*density);
+}
+
 int BaseLatticeGas::GetNumGasParticles() const
 {
-    int n_gas_particles=0;
-    for(int x=0;x<X;x++)
-        for(int y=0;y<Y;y++)
-            n_gas_particles += GetNumGasParticlesAt(x,y);
-    return n_gas_particles;
+    return (int)GetStatistics().n_gas_particles;
 }
  
 int BaseLatticeGas::GetMaxNumGasParticles() const
 {
-    int max_num_gas_particles=0;
-    for(int x=0;x<X;x++)
-        for(int y=0;y<Y;y++)
-            max_num_gas_particles += GetMaxNumGasParticlesAt(x,y);
-    return max_num_gas_particles;
+    return (int)GetStatistics().max_num_gas_particles;
+}
+
+BaseLatticeGas::Statistics BaseLatticeGas::GetStatistics() const
+{
+    const int n_blocks = (Y+STATISTICS_BLOCK_ROWS-1)/STATISTICS_BLOCK_ROWS;
+    vector<Statistics> totals(n_blocks);
+
+    #pragma omp parallel
+    {
+        vector<state> buffer(X);
+        vector<int> histogram(N_PARITIES*N_STATES); // how many cells of each parity are in each state
+
+        #pragma omp for
+        for(int i=0;i<n_blocks;i++)
+        {
+            Statistics &t = totals[i];
+            fill(histogram.begin(),histogram.end(),0);
+            for(int y=i*STATISTICS_BLOCK_ROWS;y<min(Y,(i+1)*STATISTICS_BLOCK_ROWS);y++)
+            {
+                const state *row = GetStateRow(y,&buffer[0]);
+                t.n_gas_particles += CountGasParticles(row,X);
+                int *even = &histogram[GetParity(0,y)*N_STATES], *odd = &histogram[GetParity(1,y)*N_STATES];
+                int x=0;
+                for(;x+1<X;x+=2)
+                {
+                    even[row[x]]++;
+                    odd[row[x+1]]++;
+                }
+                if(x<X)
+                    even[row[x]]++;
+            }
+            // (the momentum and the capacity follow from how many cells there are in each state)
+            for(int parity=0;parity<N_PARITIES;parity++)
+            {
+                for(int s=0;s<N_STATES;s++)
+                {
+                    const int n = histogram[parity*N_STATES+s];
+                    if(n==0) continue;
+                    t.max_num_gas_particles += n * this->state_max_num_gas_particles[s];
+                    t.momentum += RealPoint(n * this->state_velocity[parity][s].x,n * this->state_velocity[parity][s].y);
+                }
+            }
+        }
+    }
+    // add up the totals of the blocks pairwise: 0+=1, 2+=3, ..., then 0+=2, 4+=6, ... and so on
+    for(int step=1;step<n_blocks;step*=2)
+        for(int i=0;i+step<n_blocks;i+=2*step)
+            totals[i] += totals[i+step];
+    return (n_blocks>0) ? totals[0] : Statistics();
+}
+
+const BaseLatticeGas::state* BaseLatticeGas::GetStateRow(int y,state* /*buffer*/) const
+{
+    return this->grid[current_buffer].Row(y);
+}
+
+void BaseLatticeGas::FillStateTables()
+{
+    for(int s=0;s<N_STATES;s++)
+    {
+        this->state_num_gas_particles[s] = GetNumGasParticlesInState(s);
+        this->state_max_num_gas_particles[s] = GetMaxNumGasParticlesInState(s);
+        for(int parity=0;parity<N_PARITIES;parity++)
+        {
+            this->state_velocity[parity][s] = GetVelocity(s,parity&1,parity>>1);
+            for(int show_velocity=0;show_velocity<2;show_velocity++)
+            {
+                const Colour c = GetColourOfState(s,parity&1,parity>>1,show_velocity!=0);
+                this->state_colour[show_velocity][parity][s][0] = c.r;
+                this->state_colour[show_velocity][parity][s][1] = c.g;
+                this->state_colour[show_velocity][parity][s][2] = c.b;
+            }
+        }
+    }
+    // are the gas particles just the bits of the state? (as for HPP and FHP, where each bit is a particle 
+    // moving in one direction, or at rest - but not PI-LGA) if so we can count them eight cells at a time
+    this->particle_bits = 0;
+    for(int b=0;b<8;b++)
+        if(this->state_num_gas_particles[1<<b]==1)
+            this->particle_bits |= 1<<b;
+    for(int s=0;s<N_STATES;s++)
+        if(this->state_num_gas_particles[s]!=PopCount(s & this->particle_bits))
+            this->particle_bits = 0;
+}
+
+void BaseLatticeGas::GetVelocitiesOfRow(const state *row,int y,int n,RealPoint *v) const
+{
+    const RealPoint *even = this->state_velocity[GetParity(0,y)];
+    const RealPoint *odd = this->state_velocity[GetParity(1,y)];
+    int x=0;
+    for(;x+1<n;x+=2)
+    {
+        v[x] = even[row[x]];
+        v[x+1] = odd[row[x+1]];
+    }
+    if(x<n)
+        v[x] = even[row[x]];
+}
+
+void BaseLatticeGas::GetColoursOfRow(const state *row,int y,int n,bool show_velocity,unsigned char *rgb) const
+{
+    const unsigned char (*even)[3] = this->state_colour[show_velocity][GetParity(0,y)];
+    const unsigned char (*odd)[3] = this->state_colour[show_velocity][GetParity(1,y)];
+    for(int x=0;x<n;x++)
+    {
+        const unsigned char *c = (x&1) ? odd[row[x]] : even[row[x]];
+        rgb[3*x] = c[0];
+        rgb[3*x+1] = c[1];
+        rgb[3*x+2] = c[2];
+    }
+}
+
+void BaseLatticeGas::GetNumGasParticlesOfRow(const state *row,int n,int *n_particles) const
+{
+    for(int x=0;x<n;x++)
+        n_particles[x] = this->state_num_gas_particles[row[x]];
+}
+
+int BaseLatticeGas::CountGasParticles(const state *row,int n) const
+{
+    int total=0;
+    int x=0;
+    if(this->particle_bits)
+    {
+        const uint64_t mask = this->particle_bits * 0x0101010101010101ULL; // (the particle bits of eight cells)
+        for(;x+8<=n;x+=8)
+        {
+            uint64_t cells;
+            memcpy(&cells,row+x,8);
+            total += PopCount(cells & mask);
+        }
+    }
+    for(;x<n;x++)
+        total += this->state_num_gas_particles[row[x]];
+    return total;
+}
+
+int BaseLatticeGas::CountMaxGasParticles(const state *row,int n) const
+{
+    int total=0;
+    for(int x=0;x<n;x++)
+        total += this->state_max_num_gas_particles[row[x]];
+    return total;
 }
 
 int BaseLatticeGas::GetNumDemos()
@@ -132,15 +442,15 @@ int BaseLatticeGas::GetNumDemos()
     return Demo_LAST;
 }
 
-wxString BaseLatticeGas::GetDemoDescription(int i)
+string BaseLatticeGas::GetDemoDescription(int i)
 {
     switch(i)
     {
-        case Demo_Particles: return _("A few gas particles colliding");
-        case Demo_Obstacle: return _("Eddies in the wake of an obstacle");
-        case Demo_Hole: return _("Flow through a hole");
-        case Demo_KelvinHelmholtz: return _("Kelvin-Helmholtz instability");
-        default: return _("ERROR!");
+        case Demo_Particles: return "A few gas particles colliding";
+        case Demo_Obstacle: return "Eddies in the wake of an obstacle";
+        case Demo_Hole: return "Flow through a hole";
+        case Demo_KelvinHelmholtz: return "Kelvin-Helmholtz instability";
+        default: return "ERROR!";
     }
 }
 
@@ -282,6 +592,122 @@ void BaseLatticeGas::ResetGridForDemo(int i)
     }
 }
 
+bool BaseLatticeGas::IsValidGridSize(int x_size,int y_size) const
+{
+    const int block = GetCellBlockSize();
+    return x_size>0 && y_size>0 && x_size%block==0 && y_size%block==0;
+}
+
+string BaseLatticeGas::GetGridSizeRequirement() const
+{
+    ostringstream oss;
+    oss << "the width and height of the grid must be multiples of " << GetCellBlockSize() << " for this gas";
+    return oss.str();
+}
+
+void BaseLatticeGas::ResetGridForGeometry(int x_size,int y_size,const vector<bool>& is_obstacle,bool wind_tunnel)
+{
+    if(x_size<=0 || y_size<=0 || (int)is_obstacle.size()!=x_size*y_size)
+        throw runtime_error("BaseLatticeGas::ResetGridForGeometry : the obstacles don't match the size");
+    if(!IsValidGridSize(x_size,y_size))
+        throw runtime_error("BaseLatticeGas::ResetGridForGeometry : "+GetGridSizeRequirement());
+
+    // (as the wind tunnel demos)
+    this->velocity_representation = Velocity_Raw;
+    this->averaging_radius = 20;
+    this->flow_sample_separation = 20;
+    this->force_flow = wind_tunnel;
+
+    this->ResizeGrid(x_size,y_size);
+
+    for(int x=0;x<X;x++)
+        for(int y=0;y<Y;y++)
+            if((wind_tunnel && (y==0 || y==Y-1)) || is_obstacle[y*X+x])
+                SetAt(x,y,BOUNDARY);
+            else
+                InsertRandomFlow(x,y);
+}
+
+// The checkpoint is in the byte order of the machine that wrote it: a header, then the states of the
+// cells row by row (the header has the BOUNDARY state of the gas, as a check that it is the same type).
+static const char CHECKPOINT_MAGIC[8] = { 'L','G','A','C','H','K','P','T' };
+static const uint32_t CHECKPOINT_VERSION = 1;
+
+template<typename T> static void WriteValue(ostream& out,const T& value)
+{
+    out.write((const char*)&value,sizeof(T));
+}
+
+template<typename T> static void ReadValue(istream& in,T& value)
+{
+    in.read((char*)&value,sizeof(T));
+}
+
+void BaseLatticeGas::SaveCheckpoint(ostream& out) const
+{
+    out.write(CHECKPOINT_MAGIC,sizeof(CHECKPOINT_MAGIC));
+    WriteValue(out,CHECKPOINT_VERSION);
+    WriteValue(out,(int32_t)X);
+    WriteValue(out,(int32_t)Y);
+    WriteValue(out,(int32_t)this->iterations);
+    WriteValue(out,(uint32_t)GetRandomSeed());
+    WriteValue(out,(uint8_t)BOUNDARY);
+    WriteValue(out,(uint8_t)this->force_flow);
+    WriteValue(out,(int32_t)this->averaging_radius);
+    WriteValue(out,(int32_t)this->flow_sample_separation);
+    WriteValue(out,(int32_t)this->velocity_representation);
+    vector<state> buffer(X);
+    for(int y=0;y<Y;y++)
+        out.write((const char*)GetStateRow(y,&buffer[0]),X);
+    if(!out)
+        throw runtime_error("BaseLatticeGas::SaveCheckpoint : failed to write the checkpoint");
+}
+
+void BaseLatticeGas::LoadCheckpoint(istream& in)
+{
+    char magic[8];
+    uint32_t version;
+    int32_t x_size,y_size,n_iterations,radius,separation,representation;
+    uint32_t seed;
+    uint8_t boundary,flow;
+    in.read(magic,sizeof(magic));
+    ReadValue(in,version);
+    if(!in || !equal(magic,magic+8,CHECKPOINT_MAGIC) || version!=CHECKPOINT_VERSION)
+        throw runtime_error("BaseLatticeGas::LoadCheckpoint : not a checkpoint, or from a different version");
+    ReadValue(in,x_size);
+    ReadValue(in,y_size);
+    ReadValue(in,n_iterations);
+    ReadValue(in,seed);
+    ReadValue(in,boundary);
+    ReadValue(in,flow);
+    ReadValue(in,radius);
+    ReadValue(in,separation);
+    ReadValue(in,representation);
+    if(!in || x_size<=0 || y_size<=0 || separation<=0 || representation<0 || representation>=Velocity_LAST)
+        throw runtime_error("BaseLatticeGas::LoadCheckpoint : the checkpoint is damaged");
+    if(boundary!=BOUNDARY)
+        throw runtime_error("BaseLatticeGas::LoadCheckpoint : the checkpoint is of a different type of gas");
+    if(!IsValidGridSize(x_size,y_size))
+        throw runtime_error("BaseLatticeGas::LoadCheckpoint : "+GetGridSizeRequirement());
+    vector<state> cells((size_t)x_size*y_size);
+    in.read((char*)&cells[0],cells.size());
+    if(!in)
+        throw runtime_error("BaseLatticeGas::LoadCheckpoint : the checkpoint is damaged");
+
+    this->velocity_representation = (TVelocityRepresentation)representation;
+    this->averaging_radius = radius;
+    this->flow_sample_separation = separation;
+    this->force_flow = flow!=0;
+    SetRandomSeed(seed);
+
+    this->ResizeGrid(x_size,y_size);
+
+    for(int y=0;y<Y;y++)
+        for(int x=0;x<X;x++)
+            SetAt(x,y,cells[(size_t)y*X+x]);
+    this->iterations = n_iterations;
+}
+
 int BaseLatticeGas::GetIterations() const 
 { 
     return this->iterations; 
@@ -315,7 +741,7 @@ void BaseLatticeGas::SetVelocityRepresentation(int rep)
     }
     this->have_taken_first_velocity_average = false;
     this->need_recompute_flow = true;
-    this->need_redraw_images = true;
+    this->n_changes++;
 }
 
 int BaseLatticeGas::GetNumVelocityRepresentations()
@@ -323,14 +749,14 @@ int BaseLatticeGas::GetNumVelocityRepresentations()
     return Velocity_LAST;
 }
 
-wxString BaseLatticeGas::GetVelocityRepresentationAsString(int i)
+string BaseLatticeGas::GetVelocityRepresentationAsString(int i)
 {
     switch(i)
     {
-        case Velocity_Raw: return _("Raw velocity");
-        case Velocity_SubtractGlobalMean: return _("Subtract global mean velocity");
-        case Velocity_SubtractPointMean: return _("Subtract time-averaged local mean velocity");
-        default: return _("ERROR!");
+        case Velocity_Raw: return "Raw velocity";
+        case Velocity_SubtractGlobalMean: return "Subtract global mean velocity";
+        case Velocity_SubtractPointMean: return "Subtract time-averaged local mean velocity";
+        default: return "ERROR!";
     }
 }
 
@@ -354,14 +780,430 @@ void BaseLatticeGas::BringInside(int &x,int &y) const
 
 BaseLatticeGas::state BaseLatticeGas::GetAt(int x,int y) const
 {
-    return this->grid[current_buffer][x][y];
+    return this->grid[current_buffer].At(x,y);
 }
 
 void BaseLatticeGas::SetAt(int x,int y,state s)
 {
-    this->grid[current_buffer][x][y] = s;
-    this->grid[old_buffer][x][y] = s;
+    this->grid[current_buffer].At(x,y) = s;
+    if(!this->in_place)
+        this->grid[old_buffer].At(x,y) = s;
     // (by setting both buffers we don't need to copy over boundary cells)
+    this->tile_flags_iteration = -1;
+
+    const uint64_t bit = (uint64_t)1 << (x%TILE);
+    uint64_t &word = this->obstacles[y*((X+TILE-1)/TILE)+x/TILE];
+    if(((word&bit)!=0) != (s==BOUNDARY))
+    {
+        word ^= bit;
+        this->need_find_boundary_links = true;
+    }
+}
+
+void BaseLatticeGas::SetRandomSeed(unsigned int seed)
+{
+    this->random.SetSeed(seed);
+}
+
+unsigned int BaseLatticeGas::GetRandomSeed() const
+{
+    return this->random.GetSeed();
+}
+
+unsigned int BaseLatticeGas::GetRandom(TRandomStream stream,int x,int y) const
+{
+    return this->random.Get(x,y,this->iterations,stream);
+}
+
+void BaseLatticeGas::GetRandomRow(TRandomStream stream,int x,int y,int n,unsigned int *out) const
+{
+    this->random.Fill(x,y,this->iterations,stream,1,0,n,out);
+}
+
+void BaseLatticeGas::GetRandomColumn(TRandomStream stream,int x,int y,int n,unsigned int *out) const
+{
+    this->random.Fill(x,y,this->iterations,stream,0,1,n,out);
+}
+
+void BaseLatticeGas::SetTemporalBlocking(int tile_rows,int time_steps)
+{
+    this->temporal_tile_rows = max(0,tile_rows);
+    this->temporal_time_steps = max(1,time_steps);
+}
+
+int BaseLatticeGas::GetTemporalBlockingTileRows() const
+{
+    return this->temporal_tile_rows;
+}
+
+int BaseLatticeGas::GetTemporalBlockingTimeSteps() const
+{
+    return this->temporal_time_steps;
+}
+
+void BaseLatticeGas::SetInPlaceUpdates(bool in_place)
+{
+    if(in_place && !CanUpdateRows()) return; // (not supported)
+    if(in_place==this->in_place) return;
+    this->in_place = in_place;
+    if(in_place)
+        this->grid[old_buffer].Resize(0,0,0); // we don't need it any more
+    else
+        this->grid[old_buffer] = this->grid[current_buffer]; // (the boundaries must be in both)
+}
+
+bool BaseLatticeGas::GetInPlaceUpdates() const
+{
+    return this->in_place;
+}
+
+void BaseLatticeGas::AdvanceGas(int n_steps)
+{
+    // the bands must be a whole number of halos high, and at least 2*R*(T+1) rows for T steps 
+    // (see UpdateRowsTemporallyBlocked)
+    const int R = GetHaloWidth();
+    const int tile_rows = min(Y,((this->temporal_tile_rows+R-1)/R)*R);
+    const int max_steps = min(this->temporal_time_steps,tile_rows/(2*R)-1);
+    if(tile_rows<=0 || max_steps<2 || !CanUpdateRows() || this->in_place)
+    {
+        // no temporal blocking
+        for(int i=0;i<n_steps;i++)
+            UpdateGas();
+        return;
+    }
+    while(n_steps>0)
+    {
+        const int T = min(n_steps,max_steps);
+        UpdateRowsTemporallyBlocked(T,tile_rows);
+        n_steps -= T;
+    }
+}
+
+void BaseLatticeGas::UpdateAllRows()
+{
+    if(this->in_place)
+    {
+        UpdateAllRowsInPlace();
+        return;
+    }
+
+    ClassifyGridIfNeeded();
+    FindBoundaryLinksIfNeeded();
+
+    current_buffer = old_buffer;
+    old_buffer = 1-current_buffer;
+
+    // the neighbors of the cells on the edges are read from the halo
+    this->grid[old_buffer].RefreshHalo();
+
+    UpdateRows(this->grid[old_buffer],this->grid[current_buffer],0,Y,this->iterations);
+
+    this->iterations++;
+    this->tile_flags_iteration = this->iterations; // (UpdateRows classified the new rows)
+    this->need_recompute_flow = true;
+    this->n_changes++;
+}
+
+void BaseLatticeGas::UpdateAllRowsInPlace()
+{
+    // A new row depends on the old rows up to R away, so if we work down the grid R rows at a time, 
+    // the old rows R above the ones we are working on are no longer needed: we store the new rows 
+    // there, and then say that the grid has moved up R rows in memory. (The rows are computed into
+    // a line buffer first, a few at a time, since the cells in a row depend on their neighbors in 
+    // the row above.) On the next step we work up the grid instead, and move it back down again.
+    //
+    // To share the work between threads, we split the grid into chunks: if we are working down the
+    // grid, the last 2R rows of each chunk depend on rows that the next chunk will overwrite, so each 
+    // chunk computes those into scratch space first, and copies them over at the end.
+    StateGrid &G = this->grid[current_buffer];
+    const int R = GetHaloWidth();
+    if(Y<2*R)
+    {
+        // too few rows to leave the 2R that a chunk copies over at the end, so update from a copy
+        // of the grid instead (it is tiny)
+        ClassifyGridIfNeeded();
+        FindBoundaryLinksIfNeeded();
+        G.RefreshHalo();
+        const StateGrid old_grid(G);
+        UpdateRows(old_grid,G,0,Y,this->iterations);
+        this->iterations++;
+        this->tile_flags_iteration = this->iterations;
+        this->need_recompute_flow = true;
+        this->n_changes++;
+        return;
+    }
+    const bool downwards = (G.GetOriginShift()==0);
+    const int dy = downwards ? -R : R; // (where the new rows go, relative to the old ones)
+    const int chunk_rows = max(4*R,(IN_PLACE_CHUNK_ROWS/R)*R);
+    const int n_chunks = max(1,Y/chunk_rows); // (the last chunk takes up the remainder)
+    const int batch_rows = max(R,(IN_PLACE_BATCH_ROWS/R)*R);
+    const int stride = G.GetStride();
+    const int scratch_rows = 2*R+batch_rows; // for each chunk: 2R rows to copy over at the end, and the line buffer
+    vector<state> scratch(n_chunks*scratch_rows*stride);
+
+    ClassifyGridIfNeeded();
+    FindBoundaryLinksIfNeeded();
+
+    // the neighbors of the cells on the edges are read from the halo
+    G.RefreshHalo();
+
+    // first the rows that would be overwritten: the last 2R rows of each chunk (the first 2R if working upwards)
+    #pragma omp parallel for
+    for(int chunk=0;chunk<n_chunks;chunk++)
+    {
+        const int a = chunk*chunk_rows, b = (chunk==n_chunks-1) ? Y : a+chunk_rows;
+        const int from_y = downwards ? b-2*R : a;
+        StateGrid saved;
+        saved.SetView(G,from_y,&scratch[chunk*scratch_rows*stride]);
+        UpdateRows(G,saved,from_y,from_y+2*R,this->iterations);
+    }
+
+    // then the rest of the rows of each chunk, in order
+    StateGrid moved; // (the old grid, moved by dy: where the new rows go)
+    moved.SetView(G,0,G.Row(dy));
+    #pragma omp parallel for
+    for(int chunk=0;chunk<n_chunks;chunk++)
+    {
+        const int a = chunk*chunk_rows, b = (chunk==n_chunks-1) ? Y : a+chunk_rows;
+        state *saved_rows = &scratch[chunk*scratch_rows*stride];
+        state *line = saved_rows + 2*R*stride;
+        StateGrid line_buffer;
+        for(int done=0;done<b-a-2*R;done+=batch_rows)
+        {
+            const int n = min(batch_rows,b-a-2*R-done);
+            const int y = downwards ? a+done : b-done-n;
+            line_buffer.SetView(G,y,line);
+            UpdateRows(G,line_buffer,y,y+n,this->iterations);
+            for(int j=0;j<n;j++)
+                copy(line+j*stride,line+j*stride+X,moved.Row(y+j));
+        }
+        const int from_y = downwards ? b-2*R : a;
+        for(int j=0;j<2*R;j++)
+            copy(saved_rows+j*stride,saved_rows+j*stride+X,moved.Row(from_y+j));
+    }
+
+    G.MoveOrigin(downwards ? -1 : 1);
+
+    this->iterations++;
+    this->tile_flags_iteration = this->iterations;
+    this->need_recompute_flow = true;
+    this->n_changes++;
+}
+
+void BaseLatticeGas::UpdateRowsTemporallyBlocked(int n_steps,int tile_rows)
+{
+    // We use the trapezoid scheme, with the two buffers alternating as usual: step t is read from
+    // buffer[t-1] and written into buffer[t] (with buffer[t] = grid[current_buffer] for even t).
+    // A new row depends on the rows up to R away, so first each band is taken on as far as it can
+    // go on its own, shrinking by R rows at each end on each step: an upright trapezoid. Then the 
+    // gaps left where the bands meet are filled in, growing by R at each end on each step: an 
+    // inverted trapezoid. An upright trapezoid only overwrites rows of step t-2 that its neighbors
+    // will no longer need, and each trapezoid of one kind can be done at the same time as all the others.
+    const int R = GetHaloWidth();
+    const int T = n_steps;
+    const int n_bands = Y/tile_rows; // (the last band takes up the remainder)
+    StateGrid *buffer[2] = { &this->grid[current_buffer], &this->grid[old_buffer] };
+    const int first_iteration = this->iterations;
+
+    ClassifyGridIfNeeded();
+    FindBoundaryLinksIfNeeded();
+    buffer[0]->RefreshHalo();
+
+    #pragma omp parallel for schedule(static,1)
+    for(int band=0;band<n_bands;band++)
+    {
+        const int a = band*tile_rows, b = (band==n_bands-1) ? Y : a+tile_rows;
+        for(int t=1;t<=T && a+R*t<b-R*t;t++)
+        {
+            UpdateRows(*buffer[(t-1)%2],*buffer[t%2],a+R*t,b-R*t,first_iteration+t-1);
+            buffer[t%2]->RefreshHalo(a+R*t,b-R*t);
+        }
+    }
+
+    // (the inverted trapezoids are 2*R*T rows across at most, and their bands are at least 2*R*(T+1) 
+    //  rows high, so they don't get in each other's way)
+    #pragma omp parallel for schedule(static,1)
+    for(int band=0;band<n_bands;band++)
+    {
+        const int a = band*tile_rows;
+        for(int t=1;t<=T;t++)
+        {
+            // (the trapezoid at the top of the first band wraps around to the bottom of the grid)
+            const int from_y = a-R*t, to_y = a+R*t;
+            if(from_y<0)
+            {
+                UpdateRows(*buffer[(t-1)%2],*buffer[t%2],from_y+Y,Y,first_iteration+t-1);
+                buffer[t%2]->RefreshHalo(from_y+Y,Y);
+            }
+            UpdateRows(*buffer[(t-1)%2],*buffer[t%2],max(0,from_y),to_y,first_iteration+t-1);
+            buffer[t%2]->RefreshHalo(max(0,from_y),to_y);
+        }
+    }
+
+    if(T%2)
+    {
+        current_buffer = old_buffer;
+        old_buffer = 1-current_buffer;
+    }
+    this->iterations += T;
+    this->tile_flags_iteration = this->iterations;
+    this->need_recompute_flow = true;
+    this->n_changes++;
+}
+
+void BaseLatticeGas::ClassifyRow(const state *row,int y,int iteration)
+{
+    const int n_tiles = (X+TILE-1)/TILE;
+    unsigned char *flags = &this->tile_flags[iteration%2][y*n_tiles];
+    const state B = BOUNDARY;
+    for(int tile_x=0;tile_x<n_tiles;tile_x++)
+    {
+        const int from_x = tile_x*TILE, to_x = min(X,from_x+TILE);
+        // find which cells are boundaries and which are empty, the rest have particles
+        uint64_t boundary = 0, space = 0;
+        int x = from_x;
+#ifdef HAVE_BYTE_VECTOR
+        typedef ByteVector V;
+        for(;x+V::WIDTH<=to_x;x+=V::WIDTH)
+        {
+            const V::type s = V::Load(row+x);
+            boundary |= V::BitsFromMask(V::Equal(s,V::Set1(B))) << (x-from_x);
+            space |= V::BitsFromMask(V::Equal(s,V::Set1(0))) << (x-from_x);
+        }
+#endif
+        for(;x<to_x;x++)
+        {
+            boundary |= (uint64_t)(row[x]==B) << (x-from_x);
+            space |= (uint64_t)(row[x]==0) << (x-from_x);
+        }
+        const uint64_t all = (to_x-from_x==64) ? ~(uint64_t)0 : (((uint64_t)1<<(to_x-from_x))-1);
+        flags[tile_x] = (((boundary|space)!=all) ? Tile_Gas : 0) | (boundary ? Tile_Boundary : 0) | (space ? Tile_Space : 0);
+    }
+}
+
+void BaseLatticeGas::ClassifyGridIfNeeded()
+{
+    if(this->tile_flags_iteration==this->iterations) return;
+    const StateGrid &g = this->grid[current_buffer];
+    #pragma omp parallel for
+    for(int y=0;y<Y;y++)
+        ClassifyRow(g.Row(y),y,this->iterations);
+    this->tile_flags_iteration = this->iterations;
+}
+
+BaseLatticeGas::TTileClass BaseLatticeGas::GetTileClass(unsigned char flags)
+{
+    if(flags==Tile_Boundary) return Tile_Solid;
+    if(flags==Tile_Space) return Tile_Empty;
+    if(flags==Tile_Gas) return Tile_Dense;
+    return Tile_Mixed;
+}
+
+int BaseLatticeGas::GetNextRun(int y,int from_x,int iteration,bool &active) const
+{
+    // A tile can only change if there are particles within reach: the rows are updated R at a time, 
+    // from the R rows either side, and we allow for particles that come from up to 2R cells away along 
+    // the row (so we look at the tiles that hold the 2R cells either side, which wrap around). A tile 
+    // that is all boundary never changes, and the inlet (if any) is overwritten on every step.
+    // (this is called for every row, so we avoid divisions and virtual calls in the loop)
+    const int R = GetHaloWidth();
+    const int n_tiles = (X+TILE-1)/TILE;
+    const unsigned char *flags = &this->tile_flags[iteration%2][0];
+    const int first_y = (y/R)*R;
+    int tile_x = from_x/TILE;
+    for(;tile_x<n_tiles;tile_x++)
+    {
+        bool tile_active = false;
+        const unsigned char f = flags[y*n_tiles+tile_x];
+        if((f&Tile_Gas) || (this->force_flow && tile_x==0))
+            tile_active = true; // (the usual case, where there is gas)
+        else if(GetTileClass(f)!=Tile_Solid)
+        {
+            const int x0 = tile_x*TILE, x1 = min(X,x0+TILE);
+            int nbor_x[4] = { x0-2*R, x0-1, x1, x1+2*R-1 };
+            int nbors[5];
+            nbors[4] = tile_x;
+            for(int i=0;i<4;i++)
+            {
+                if(nbor_x[i]<0) nbor_x[i] += X;
+                else if(nbor_x[i]>=X) nbor_x[i] -= X;
+                nbors[i] = nbor_x[i]/TILE;
+            }
+            for(int j=first_y-R;j<first_y+2*R && !tile_active;j++)
+            {
+                const unsigned char *row = flags + ((j<0) ? j+Y : ((j>=Y) ? j-Y : j))*n_tiles;
+                for(int i=0;i<5;i++)
+                    tile_active |= (row[nbors[i]]&Tile_Gas)!=0;
+            }
+        }
+        if(tile_x==from_x/TILE)
+            active = tile_active;
+        else if(tile_active!=active)
+            break;
+    }
+    return min(X,tile_x*TILE);
+}
+
+bool BaseLatticeGas::IsObstacle(int x,int y) const
+{
+    // (x and y may be more than a grid away on a tiny grid)
+    x %= X; if(x<0) x += X;
+    y %= Y; if(y<0) y += Y;
+    return (this->obstacles[y*((X+TILE-1)/TILE)+x/TILE] >> (x%TILE)) & 1;
+}
+
+void BaseLatticeGas::FindBoundaryLinksIfNeeded()
+{
+    if(!this->need_find_boundary_links) return;
+    const int R = GetHaloWidth();
+    const int n_tiles = (X+TILE-1)/TILE;
+    this->boundary_links.clear();
+    for(int y=0;y<Y;y++)
+    {
+        this->first_boundary_link[y] = (int)this->boundary_links.size();
+        for(int tile_x=0;tile_x<n_tiles;tile_x++)
+        {
+            // (most tiles are nowhere near an obstacle, see GetBoundaryLinks - we look two tiles either
+            // side, since the last tile might be narrow)
+            uint64_t nearby = 0;
+            for(int j=y-2*R;j<=y+2*R;j++)
+                for(int i=tile_x-2;i<=tile_x+2;i++)
+                    nearby |= this->obstacles[(((j%Y)+Y)%Y)*n_tiles+(((i%n_tiles)+n_tiles)%n_tiles)];
+            if(!nearby) continue;
+            for(int x=tile_x*TILE;x<min(X,(tile_x+1)*TILE);x++)
+            {
+                BoundaryLink link;
+                link.x = x;
+                link.links = GetBoundaryLinks(x,y);
+                if(link.links)
+                    this->boundary_links.push_back(link);
+            }
+        }
+    }
+    this->first_boundary_link[Y] = (int)this->boundary_links.size();
+    this->need_find_boundary_links = false;
+}
+
+void BaseLatticeGas::RestoreObstacles(state *row,int y,int from_x,int to_x) const
+{
+    const int n_tiles = (X+TILE-1)/TILE;
+    for(int tile_x=from_x/TILE;tile_x*TILE<to_x;tile_x++)
+    {
+        uint64_t bits = this->obstacles[y*n_tiles+tile_x];
+        for(int x=tile_x*TILE;bits;x++,bits>>=1)
+            if(bits&1)
+                row[x] = BOUNDARY;
+    }
+}
+
+unsigned int BaseLatticeGas::GetRandom(TRandomStream stream,int x,int y,int iteration) const
+{
+    return this->random.Get(x,y,iteration,stream);
+}
+
+void BaseLatticeGas::GetRandomRow(TRandomStream stream,int x,int y,int n,unsigned int *out,int iteration) const
+{
+    this->random.Fill(x,y,iteration,stream,1,0,n,out);
 }
 
 RealPoint BaseLatticeGas::GetAverageVelocityPerParticle() const
@@ -20,29 +20,54 @@
 #define __BASELATTICEGAS_H__
 
 // local:
-#include "wxWidgetsPreamble.h"
+#include "StateGrid.h"
+#include "CounterBasedRandom.h"
 
 // STL:
 #include <vector>
 #include <string>
+#include <istream>
+#include <ostream>
 using std::vector;
 using std::string;
+using std::istream;
+using std::ostream;
+
+// standard library:
+#include <stdint.h>
 
 // (a simple replacement for wxRealPoint, to avoid dependencies)
 class RealPoint {
     public:
         double x,y;
         RealPoint(double x=0.0,double y=0.0) : x(x), y(y) {}
-        RealPoint(const RealPoint& r) : x(r.x), y(r.y) {}
         RealPoint operator+(const RealPoint& b) { return RealPoint(x+b.x,y+b.y); }
         RealPoint& operator+=(const RealPoint& b) { x+=b.x; y+=b.y; return *this; }
         RealPoint operator*(const double m) { return RealPoint(x*m,y*m); }
         RealPoint& operator*=(const double m) { x*=m; y*=m; return *this; }
 };
 
-// Abstract base class for all 2D lattice gas implementations. 
+// (and of wxColour)
+class Colour {
+    public:
+        unsigned char r,g,b;
+        Colour(unsigned char r=0,unsigned char g=0,unsigned char b=0) : r(r), g(g), b(b) {}
+};
+
+// Abstract base class for all 2D lattice gas implementations. The gases don't depend on any GUI 
+// library, so that they can be used by programs with no display: to show a gas, a view reads its 
+// cells and its flow through the public functions below (see LatticeGasRenderer).
 class BaseLatticeGas 
 {
+    public: // typedefs
+
+        typedef StateGrid::state state;
+
+        enum TVelocityRepresentation { Velocity_Raw, Velocity_SubtractGlobalMean, Velocity_SubtractPointMean, Velocity_LAST };
+        enum TDemo { Demo_Particles, Demo_Obstacle, Demo_Hole, Demo_KelvinHelmholtz, Demo_LAST };
+
+        static const int N_STATES = 256, N_PARITIES = 4; // (see FillStateTables)
+
 	public: // overrideables
         
         // update the gas by applying one timestep
@@ -62,10 +87,43 @@ class BaseLatticeGas
 
         virtual void ResetGridForDemo(int i);
         static int GetNumDemos();
-        static wxString GetDemoDescription(int i);
+        static string GetDemoDescription(int i);
+
+        // set up a wind tunnel like the demos, of the given size, with obstacles where is_obstacle is 
+        // set (row by row): the top and bottom rows are walls, and the gas flows in from the left
+        // (unless wind_tunnel is false: then there are no walls and no forcing, and the flow wraps 
+        // around all four edges with nothing but the obstacles to change it)
+        virtual void ResetGridForGeometry(int x_size,int y_size,const vector<bool>& is_obstacle,bool wind_tunnel=true);
+
+        // restore the grid, the iteration count, the random seed and the flow settings from a 
+        // checkpoint made by SaveCheckpoint (by a gas of the same type) - throws runtime_error if 
+        // the checkpoint can't be read
+        virtual void LoadCheckpoint(istream& in);
+
+        // the states of the X cells in row y: a pointer into the grid, or buffer (with room for X) 
+        // filled with them, for the gases that keep their cells elsewhere
+        virtual const state* GetStateRow(int y,state *buffer) const;
+
+        // the colour to show a cell in state s at x,y: the colour of its velocity (show_velocity), 
+        // or a shade of grey for its density (only whether x and y are odd or even may matter)
+        virtual Colour GetColourOfState(state s,int x,int y,bool show_velocity) const =0;
+
+        // how the cells are laid out, for drawing them: on a hex grid every other row is shifted by 
+        // half a cell (see HexGridLatticeGas), and some gases work on square blocks of cells (so the 
+        // width and height of their grid must be multiples of the block size)
+        virtual bool IsOnHexGrid() const { return false; }
+        virtual int GetCellBlockSize() const { return 1; }
+
+        // can the grid be made this size? (ResetGridForGeometry and LoadCheckpoint throw if not)
+        bool IsValidGridSize(int x_size,int y_size) const;
+
+        // how many bytes one copy of the grid takes for each cell (a step reads one copy and writes 
+        // the other, so it moves at least twice this for each cell)
+        virtual double GetBytesPerCell() const { return sizeof(state); }
 
     public: // functions
 
+        BaseLatticeGas();
         virtual ~BaseLatticeGas() {}
 
         int GetIterations() const;
@@ -73,37 +131,127 @@ class BaseLatticeGas
         void SetAveragingRadius(int ar);
         int GetVelocityRepresentation() const;
         void SetVelocityRepresentation(int i);
-        static wxString GetVelocityRepresentationAsString(int i);
+        static string GetVelocityRepresentationAsString(int i);
         static int GetNumVelocityRepresentations();
         int GetX() const;
         int GetY() const;
 
+        // write everything needed to carry on from here to a (binary) stream (see LoadCheckpoint)
+        void SaveCheckpoint(ostream& out) const;
+
+        // The flow is averaged over a window around each of a grid of sample points (see ComputeFlow):
+        // point sx,sy is at cell sx*S,sy*S, where S is the sample separation, and only the points at 
+        // least S from the edges are computed (the others are zero).
+        void ComputeFlowIfNeeded();
+        int GetFlowSampleSeparation() const;
+        RealPoint GetFlow(int sx,int sy) const;
+        RealPoint GetAveragedFlow(int sx,int sy) const; // (a running average over time)
+        RealPoint GetFlowAsRepresented(int sx,int sy) const; // (as chosen by SetVelocityRepresentation)
+
+        // goes up by one whenever something changes that a view of the gas would show (each update,
+        // and each change to the grid or to the flow settings), so a view can tell when to redraw
+        unsigned int GetNumChanges() const;
+
+        // which of the N_PARITIES kinds of cell x,y is: x odd or even, y odd or even
+        static int GetParity(int x,int y) { return (x&1) + 2*(y&1); }
+
+        // colours for a direction (by its angle) and for a density (0 to 1)
+        static Colour GetVectorAngleColour(float x,float y);
+        static Colour GetDensityColour(float density);
+
+        // the colours of the n cells from x=0 in row y (whose states are row), as r,g,b bytes, as
+        // GetColourOfState would give them (but from the state tables, see FillStateTables)
+        void GetColoursOfRow(const state *row,int y,int n,bool show_velocity,unsigned char *rgb) const;
+
         // retrieve the overall number of gas particles
         int GetNumGasParticles() const;
 
         // if density was 100%, how many gas particles would there be?
         int GetMaxNumGasParticles() const;
 
+        // the totals over the whole grid
+        struct Statistics
+        {
+            int64_t n_gas_particles;
+            int64_t max_num_gas_particles; // (if the density was 100%)
+            RealPoint momentum;
+
+            Statistics() : n_gas_particles(0), max_num_gas_particles(0) {}
+            Statistics& operator+=(const Statistics& s) 
+            { 
+                n_gas_particles += s.n_gas_particles;
+                max_num_gas_particles += s.max_num_gas_particles;
+                momentum += s.momentum;
+                return *this;
+            }
+        };
+
+        // add up the statistics of the gas, in parallel (the rows are taken in fixed blocks, whose totals 
+        // are combined pairwise in a fixed order, so the result is the same however many threads there are)
+        Statistics GetStatistics() const;
+
+        // every random choice the gas makes (when setting up a demo and on each update) is a
+        // function of this seed, so a run can be repeated exactly, with any number of threads
+        // (the seed starts off as rand(), and is kept when the grid is reset)
+        void SetRandomSeed(unsigned int seed);
+        unsigned int GetRandomSeed() const;
+
+        // advance the gas by n_steps timesteps: the same as calling UpdateGas n_steps times, but
+        // using temporal blocking if it is turned on (see SetTemporalBlocking)
+        void AdvanceGas(int n_steps);
+
+        // Temporal blocking: rather than sweeping the whole grid through the cache on every step,
+        // AdvanceGas splits it into bands of (at least) tile_rows rows and takes each band up to
+        // time_steps steps on while it is in the cache. (tile_rows=0 turns it off, and it only 
+        // applies to the gases that can update a few rows on their own, see UpdateRows)
+        void SetTemporalBlocking(int tile_rows,int time_steps);
+        int GetTemporalBlockingTileRows() const;
+        int GetTemporalBlockingTimeSteps() const;
+
+        // In-place updates: keep just the one copy of the grid, and update it where it is, to halve
+        // the memory needed (see UpdateAllRowsInPlace). Only the gases that can update a few rows at 
+        // a time can do this (see UpdateRows), and it turns off temporal blocking.
+        void SetInPlaceUpdates(bool in_place);
+        bool GetInPlaceUpdates() const;
+
     protected: // typedefs
 
-        typedef unsigned char state;
+        // the random numbers for different purposes are kept independent
+        enum TRandomStream { Random_Initialization, Random_Inflow, Random_Collisions };
 
-        enum TVelocityRepresentation { Velocity_Raw, Velocity_SubtractGlobalMean, Velocity_SubtractPointMean, Velocity_LAST };
-        enum TDemo { Demo_Particles, Demo_Obstacle, Demo_Hole, Demo_KelvinHelmholtz, Demo_LAST };
+        // what kinds of cell does a tile hold? (see ClassifyRow)
+        enum TTileFlags { Tile_Gas=1, Tile_Boundary=2, Tile_Space=4 };
+        enum TTileClass { Tile_Empty, Tile_Solid, Tile_Mixed, Tile_Dense };
 
     protected: // overrideables
     
         // resize the grid to the specified size, leaving it empty
         virtual void ResizeGrid(int x_size,int y_size);
-        
-        // retrieve the number of gas particles in a particular square
-        virtual int GetNumGasParticlesAt(int x,int y) const =0;
 
-        // if the gas density were 100% in a square, how many particles would there be?
-        virtual int GetMaxNumGasParticlesAt(int x,int y) const =0;
+        // how deep is the halo of ghost cells around the grid? (see StateGrid)
+        // (should be at least as far as a particle can travel in one step)
+        virtual int GetHaloWidth() const { return 1; }
 
-        // what is the velocity of the given location?
-        virtual RealPoint GetVelocityAt(int x,int y) const =0;
+        // for cell x,y, which of its links lead to an obstacle? (see FindBoundaryLinksIfNeeded) The meaning 
+        // of the bits is up to the gas, but the cell only goes on the list if some are set. (Only obstacles 
+        // within 2R rows and TILE cells of x,y need be considered, where R is GetHaloWidth.)
+        virtual state GetBoundaryLinks(int /*x*/,int /*y*/) const { return 0; }
+
+        // can this gas be updated a few rows at a time with UpdateRows? (not if it keeps its cells elsewhere)
+        virtual bool CanUpdateRows() const { return false; }
+
+        // compute rows from_y to to_y-1 of out for iteration+1, from in for iteration (whose halo must be 
+        // up to date); a row may only depend on the rows of in that are up to GetHaloWidth() away 
+        // (from_y and to_y are multiples of GetHaloWidth(), and inside the grid)
+        virtual void UpdateRows(const StateGrid& /*in*/,StateGrid& /*out*/,int /*from_y*/,int /*to_y*/,int /*iteration*/) {}
+        
+        // the number of gas particles in a cell in state s, and how many there would be if the gas 
+        // density there were 100%
+        virtual int GetNumGasParticlesInState(state s) const =0;
+        virtual int GetMaxNumGasParticlesInState(state s) const =0;
+
+        // the velocity of a cell in state s at x,y (only whether x and y are odd or even may matter)
+        virtual RealPoint GetVelocity(state s,int x,int y) const =0;
 
         // get a text description of a state
         virtual string GetReport(state s) const =0;
@@ -114,6 +262,9 @@ class BaseLatticeGas
 
     protected: // functions
 
+        // what IsValidGridSize asks for, for the error messages
+        string GetGridSizeRequirement() const;
+
         // compute the average flow of the gas at regular intervals
         void ComputeFlow();
 
@@ -121,20 +272,93 @@ class BaseLatticeGas
 
         void BringInside(int &x,int &y) const;
 
+        // apply one timestep, using UpdateRows (for the gases that can, to implement UpdateGas)
+        void UpdateAllRows();
+
+        // apply n_steps timesteps using UpdateRows, in bands of tile_rows rows (see SetTemporalBlocking)
+        void UpdateRowsTemporallyBlocked(int n_steps,int tile_rows);
+
+        // apply one timestep using UpdateRows, with just the one grid (see SetInPlaceUpdates)
+        void UpdateAllRowsInPlace();
+
+        // Tile classification: each row is split into tiles of TILE cells, and we keep a note of 
+        // whether each tile has any particles, boundaries and empty cells in it (see TTileFlags),
+        // for the current iteration and the next. A tile that is all boundary, or that has no particles
+        // in it or within a halo of it, is the same on the next step, so UpdateRows can just copy it over.
+        // The update of each row classifies its new cells while they are in the cache, so this is cheap.
+
+        // record the flags of row y (of X cells) for the given iteration
+        void ClassifyRow(const state *row,int y,int iteration);
+
+        // classify the whole of the current grid, unless it was classified after the last update
+        void ClassifyGridIfNeeded();
+
+        // the class of a tile, from its flags: all empty, all boundary, all particles, or a mix
+        static TTileClass GetTileClass(unsigned char flags);
+
+        // from cell from_x of row y, find the end of the run of tiles that all need computing on the
+        // given iteration (active=true) or that can all be copied over (active=false)
+        int GetNextRun(int y,int from_x,int iteration,bool &active) const;
+
+        // Obstacles: as well as being BOUNDARY cells in the grid, the obstacles are kept in a bit mask 
+        // (see SetAt), and from that we make a list of the cells next to them: the boundary links. The 
+        // kernels can then move the particles as if there were no obstacles, and afterwards apply the 
+        // bounce-back on just the cells in the list, and put the obstacle cells back.
+
+        // is cell x,y an obstacle? (x and y can be up to a grid's width or height outside, and are wrapped around)
+        bool IsObstacle(int x,int y) const;
+
+        // make the list of boundary links, unless the obstacles haven't changed since we last did
+        void FindBoundaryLinksIfNeeded();
+
+        // write BOUNDARY into the obstacle cells from from_x to to_x-1 of row y (from_x must be a multiple of TILE)
+        void RestoreObstacles(state *row,int y,int from_x,int to_x) const;
+
+        // State tables: the velocity, the particle counts and the colours of every state, for each parity of cell 
+        // (see GetParity), so that a row of states can be converted in one call with no virtual call 
+        // for each cell. The gas only has to say what they are for one state (see above).
+        
+        // fill the state tables (done when the grid is resized)
+        void FillStateTables();
+
+        // the velocity and the number of gas particles of each of the n cells from x=0 in row y (whose
+        // states are row)
+        void GetVelocitiesOfRow(const state *row,int y,int n,RealPoint *v) const;
+        void GetNumGasParticlesOfRow(const state *row,int n,int *n_particles) const;
+
+        // the total number of gas particles in n cells, and the most there could be (when each particle 
+        // is a bit of the state, see FillStateTables, the particles are counted eight cells at a time)
+        int CountGasParticles(const state *row,int n) const;
+        int CountMaxGasParticles(const state *row,int n) const;
+
         state GetAt(int x,int y) const;
         void SetAt(int x,int y,state s);
 
+        // returns a random number for cell x,y on this iteration (the same whichever thread asks, and
+        // however many times; x and y needn't be inside the grid, so can be used to pick out other numbers)
+        unsigned int GetRandom(TRandomStream stream,int x,int y) const;
+
+        // the same for n cells at once, along the row from x,y or down the column from x,y
+        void GetRandomRow(TRandomStream stream,int x,int y,int n,unsigned int *out) const;
+        void GetRandomColumn(TRandomStream stream,int x,int y,int n,unsigned int *out) const;
+
+        // the same for a given iteration (for the updates, which might not be working on this one, see UpdateRows)
+        unsigned int GetRandom(TRandomStream stream,int x,int y,int iteration) const;
+        void GetRandomRow(TRandomStream stream,int x,int y,int n,unsigned int *out,int iteration) const;
+
     protected: // data
 
         int X;
         int Y;
-        vector<vector<state> > grid[2]; // two buffers that get swapped each iteration
+        StateGrid grid[2]; // two buffers that get swapped each iteration
         int current_buffer,old_buffer;
 
         state BOUNDARY;
 
         int iterations;
 
+        CounterBasedRandom random; // (keyed by the cell, the iteration and the stream)
+
         vector<state> forward_flow_samples; // we sample from this to bias the flow
         vector<state> backward_flow_samples; // (sometimes we use this too)
         int flow_sample_separation; // we compute the flow at sparse positions (X and Y should divide by this)
@@ -144,8 +368,28 @@ class BaseLatticeGas
         RealPoint global_mean_velocity;
 
         bool force_flow; // are we forcing the flow by overwriting the leftmost column?
+
+        int temporal_tile_rows,temporal_time_steps; // (see SetTemporalBlocking)
+        bool in_place; // if set then grid[old_buffer] is empty (see SetInPlaceUpdates)
+        static const int IN_PLACE_CHUNK_ROWS = 256, IN_PLACE_BATCH_ROWS = 16; // (see UpdateAllRowsInPlace)
+
+        static const int TILE = 64; // the width of a tile, in cells (no more than 64, see ClassifyRow)
+        vector<unsigned char> tile_flags[2]; // Y rows of tiles, for the even and the odd iterations
+        int tile_flags_iteration; // the tile flags are for the current grid if this is equal to iterations
+
+        RealPoint state_velocity[N_PARITIES][N_STATES];
+        unsigned char state_num_gas_particles[N_STATES],state_max_num_gas_particles[N_STATES];
+        unsigned char state_colour[2][N_PARITIES][N_STATES][3]; // (without and with show_velocity, see GetColourOfState)
+        state particle_bits; // if non-zero, the number of gas particles in a state is the number of these bits it has set
+        static const int STATISTICS_BLOCK_ROWS = 16; // (see GetStatistics)
+
+        struct BoundaryLink { int x; state links; }; // (a cell next to an obstacle, see GetBoundaryLinks)
+        vector<uint64_t> obstacles; // one bit for each cell, a word for each tile
+        vector<BoundaryLink> boundary_links; // row by row, in order of x
+        vector<int> first_boundary_link; // row y's links start at boundary_links[first_boundary_link[y]] (Y+1 entries)
+        bool need_find_boundary_links; // have the obstacles changed?
         
-        bool need_redraw_images; // has anything changed since we last drew the images?
+        unsigned int n_changes; // (see GetNumChanges)
         bool need_recompute_flow; // has anything changed since we last computed the flow?
 
         // velocity computation flags
@@ -0,0 +1,189 @@
+/*
+    Lattice Gas Explorer
+    Copyright (C) 2008-2009 Tim J. Hutton <tim.hutton@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "BitPlaneFHPLatticeGas.h"
+#include "FHPCollisionKernels.h" // (generated when building, see lga_generate_kernels.cpp)
+
+// STL:
+#include <algorithm>
+
+using namespace std;
+
+BitPlaneFHPLatticeGas::BitPlaneFHPLatticeGas(FHP_type type) : FHPLatticeGas(type)
+{
+    this->collision_kernel = GetFHPCollisionKernel(type);
+    if(!this->collision_kernel)
+        this->collision_flips.Compile(9,7,GetCollisionFlipTable());
+}
+
+void BitPlaneFHPLatticeGas::ApplyCollisions(const word* const* inputs,word* const* outputs,int n_words,vector<word>& scratch) const
+{
+    if(this->collision_kernel)
+        this->collision_kernel(inputs,outputs,n_words);
+    else
+        this->collision_flips.Evaluate(inputs,outputs,n_words,scratch);
+}
+
+void BitPlaneFHPLatticeGas::ResetGridForDemo(int i)
+{
+    // the demos are written into grid as usual, then we convert them
+    FHPLatticeGas::ResetGridForDemo(i);
+    PackGrid();
+}
+
+void BitPlaneFHPLatticeGas::ResetGridForGeometry(int x_size,int y_size,const vector<bool>& is_obstacle,bool wind_tunnel)
+{
+    FHPLatticeGas::ResetGridForGeometry(x_size,y_size,is_obstacle,wind_tunnel);
+    PackGrid();
+}
+
+void BitPlaneFHPLatticeGas::LoadCheckpoint(istream& in)
+{
+    FHPLatticeGas::LoadCheckpoint(in);
+    PackGrid();
+}
+
+void BitPlaneFHPLatticeGas::PackGrid()
+{
+    this->planes[0].Resize(X,Y,N_PLANES);
+    this->planes[1].Resize(X,Y,N_PLANES);
+    for(int y=0;y<Y;y++)
+        this->planes[current_buffer].SetRowStates(y,this->grid[current_buffer].Row(y));
+}
+
+void BitPlaneFHPLatticeGas::UpdateGas()
+{
+    current_buffer = old_buffer;
+    old_buffer = 1-current_buffer;
+
+    const BitPlaneGrid &OldPlanes = this->planes[old_buffer];
+    BitPlaneGrid &NewPlanes = this->planes[current_buffer];
+    const int W = OldPlanes.GetWordsPerRow();
+    const word last_word_mask = OldPlanes.GetLastWordMask();
+    const int n_choice_words = (X+31)/32; // (see FHPLatticeGas::GetCollisionChoices)
+
+    // the collision circuit is evaluated on a band of rows at a time (see BitSlicedCircuit::WORDS_PER_PASS)
+    const int band_rows = max(1,BitSlicedCircuit::WORDS_PER_PASS/W);
+    const int n_bands = (Y+band_rows-1)/band_rows;
+
+    #pragma omp parallel
+    {
+        vector<unsigned int> choice_bits(2*n_choice_words+1);
+        // the planes of the band between propagation and collision (7 for the bits of the state, then 2 for
+        // the collision choice, each with the rows one after another), the bits that the collisions flip,
+        // and the circuit's scratch space
+        const int band_words = BitSlicedCircuit::GetPaddedSize(band_rows*W);
+        vector<word> band_planes(9*band_words),flip_planes(7*band_words),scratch;
+        vector<word> in(W),in_boundary(W); // (a row of inbound particles and boundaries, see ShiftRow)
+        const word *circuit_in[9];
+        word *circuit_out[7];
+        for(int p=0;p<9;p++)
+            circuit_in[p] = &band_planes[p*band_words];
+        for(int b=0;b<7;b++)
+            circuit_out[b] = &flip_planes[b*band_words];
+
+        // (each row draws its own random numbers, so the result doesn't depend on how the rows are shared out)
+        #pragma omp for
+        for(int band=0;band<n_bands;band++)
+        {
+            const int from_y = band*band_rows;
+            const int to_y = min(Y,from_y+band_rows);
+
+            for(int y=from_y;y<to_y;y++)
+            {
+                // the same collision choices as FHPLatticeGas makes, one bit-plane for each bit of the choice
+                GetCollisionChoices(y,this->iterations,n_choice_words,&choice_bits[0]);
+                const unsigned int *choice_low = &choice_bits[0];
+                const unsigned int *choice_high = &choice_bits[n_choice_words];
+
+                const vector<vector<int> > &nbors = NBORS[y%2]; // alternate rows are indented (see HexGridLatticeGas)
+
+                // for each direction: which row, and which side, does an inbound particle come from?
+                const word *src[N_DIRS],*src_boundary[N_DIRS];
+                int src_dx[N_DIRS];
+                for(int dir=0;dir<N_DIRS;dir++)
+                {
+                    const int sy = (y+nbors[opposite_dir(dir)][1]+Y)%Y;
+                    src[dir] = OldPlanes.Row(sy,dir);
+                    src_boundary[dir] = OldPlanes.Row(sy,BOUNDARY_PLANE);
+                    src_dx[dir] = nbors[opposite_dir(dir)][0];
+                }
+                const word *c[N_PLANES];
+                for(int p=0;p<N_PLANES;p++)
+                    c[p] = OldPlanes.Row(y,p);
+                word *n[9];
+                for(int p=0;p<9;p++)
+                    n[p] = &band_planes[p*band_words+(y-from_y)*W];
+
+                // propagation
+                for(int dir=0;dir<N_DIRS;dir++)
+                {
+                    OldPlanes.ShiftRow(src[dir],src_dx[dir],&in[0]);
+                    OldPlanes.ShiftRow(src_boundary[dir],src_dx[dir],&in_boundary[0]);
+                    const word *reverse = c[opposite_dir(dir)];
+                    // accept an inbound particle travelling in this direction, or if the neighbor
+                    // is a boundary then reverse one of our own particles
+                    for(int w=0;w<W;w++)
+                        n[dir][w] = (in[w] & ~in_boundary[w]) | (in_boundary[w] & reverse[w]);
+                }
+                for(int w=0;w<W;w++)
+                {
+                    n[6][w] = c[6][w]; // (rest particles stay put)
+                    n[7][w] = (word)choice_low[2*w] | ((word)choice_low[2*w+1]<<32);
+                    n[8][w] = (word)choice_high[2*w] | ((word)choice_high[2*w+1]<<32);
+                }
+            }
+
+            // collisions
+            ApplyCollisions(circuit_in,circuit_out,(to_y-from_y)*W,scratch);
+
+            for(int y=from_y;y<to_y;y++)
+            {
+                const word *boundary = OldPlanes.Row(y,BOUNDARY_PLANE);
+                const int offset = (y-from_y)*W;
+                // boundary cells don't change, and the bits beyond the end of the row stay empty
+                for(int b=0;b<7;b++)
+                {
+                    const word *before = circuit_in[b]+offset,*flips = circuit_out[b]+offset;
+                    word *after = NewPlanes.Row(y,b);
+                    for(int w=0;w<W;w++)
+                        after[w] = (before[w] ^ flips[w]) & ~boundary[w];
+                    after[W-1] &= last_word_mask;
+                }
+                copy(boundary,boundary+W,NewPlanes.Row(y,BOUNDARY_PLANE));
+
+                if(force_flow && !(boundary[0]&1))
+                {
+                    // the left-most column gets overwritten randomly, since we are simulating
+                    // an infinite tube filled with moving gas
+                    NewPlanes.SetState(0,y,GetInflowSample(y,this->iterations));
+                }
+            }
+        }
+    }
+
+    this->iterations++;
+    this->need_recompute_flow = true;
+    this->n_changes++;
+}
+
+const BaseLatticeGas::state* BitPlaneFHPLatticeGas::GetStateRow(int y,state *buffer) const
+{
+    this->planes[current_buffer].GetRowStates(y,buffer);
+    return buffer;
+}
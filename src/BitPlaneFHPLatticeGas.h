@@ -0,0 +1,85 @@
+/*
+    Lattice Gas Explorer
+    Copyright (C) 2008-2009 Tim J. Hutton <tim.hutton@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BITPLANEFHPLATTICEGAS__
+#define __BITPLANEFHPLATTICEGAS__
+
+#include "FHPLatticeGas.h"
+#include "BitPlaneGrid.h"
+#include "BitSlicedCircuit.h"
+
+// The same gas as FHPLatticeGas but stored as bit-planes, so that each step
+// updates 64 cells at a time: propagation is done with word shifts and the
+// collisions are evaluated as boolean logic, with no per-cell branches or lookups.
+// The logic is compiled from the collision classes (see BitSlicedCircuit), so each
+// variant gets its own minimal circuit: for the built-in variants this is done when
+// the program is built, and the circuit is written out as straight-line code (see
+// lga_generate_kernels.cpp), which is much faster than interpreting it. Even so, on
+// open flows this engine is slower than FHPLatticeGas (making the random collision
+// choices costs as much as it does there, and the FHP-III circuit is large); it is
+// faster where there are many obstacles.
+class BitPlaneFHPLatticeGas : public FHPLatticeGas
+{
+    public:
+
+        BitPlaneFHPLatticeGas(FHP_type type);
+
+        void UpdateGas(); // override
+
+        void ResetGridForDemo(int i); // override
+        void ResetGridForGeometry(int x_size,int y_size,const vector<bool>& is_obstacle,bool wind_tunnel=true); // override
+        void LoadCheckpoint(istream& in); // override
+
+        double GetBytesPerCell() const { return N_PLANES/8.0; } // override
+
+    protected: // typedefs
+
+        typedef BitSlicedCircuit::word word;
+
+        // a compiled circuit: the same as BitSlicedCircuit::Evaluate, with no padding needed
+        typedef void (*CollisionKernel)(const word* const* inputs,word* const* outputs,int n_words);
+
+    protected: // functions
+
+        // from the 7 bits of the state and the 2 of the collision choice for n_words words of cells,
+        // which of the 7 bits change? (scratch is for collision_flips, if that is used)
+        void ApplyCollisions(const word* const* inputs,word* const* outputs,int n_words,vector<word>& scratch) const;
+
+        bool CanUpdateRows() const { return false; } // override (we keep our cells in the bit-planes)
+
+        const state* GetStateRow(int y,state *buffer) const; // override
+
+        // copy the contents of grid[current_buffer] into the bit-planes
+        void PackGrid();
+
+    protected: // data
+
+        // bits 0-6 of the state (E,SE,SW,W,NW,NE,REST) get a plane each, plus one for the boundary
+        static const int BOUNDARY_PLANE = 7;
+        static const int N_PLANES = 8;
+
+        BitPlaneGrid planes[2]; // indexed by current_buffer,old_buffer, as for grid
+
+        // the collisions: from the 7 bits of a cell's state and the 2 bits of its collision choice
+        // (see GetCollisionChoices), which of the 7 bits change? (compiled at build time, or if there
+        // is no kernel for our variant then compiled when the gas is made)
+        CollisionKernel collision_kernel;
+        BitSlicedCircuit collision_flips;
+};
+
+#endif
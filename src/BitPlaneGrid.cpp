@@ -0,0 +1,120 @@
+/*
+    Lattice Gas Explorer
+    Copyright (C) 2008-2009 Tim J. Hutton <tim.hutton@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "BitPlaneGrid.h"
+
+// standard library:
+#include <string.h>
+
+// the 8 bits of b spread out into the bottom bit of each of 8 bytes, for GetRowStates
+struct SpreadTable
+{
+    BitPlaneGrid::word entries[256];
+    SpreadTable()
+    {
+        for(int b=0;b<256;b++)
+        {
+            unsigned char bytes[8];
+            for(int i=0;i<8;i++)
+                bytes[i] = (b>>i)&1;
+            memcpy(&entries[b],bytes,8);
+        }
+    }
+};
+static const SpreadTable SPREAD;
+
+BitPlaneGrid::BitPlaneGrid() : X(0), Y(0), N_PLANES(0), W(0), last_bit(0), last_word_mask(0)
+{
+}
+
+void BitPlaneGrid::Resize(int x_size,int y_size,int n_planes)
+{
+    this->X = x_size;
+    this->Y = y_size;
+    this->N_PLANES = n_planes;
+    this->W = (X+BITS_PER_WORD-1)/BITS_PER_WORD;
+    this->last_bit = (X-1)%BITS_PER_WORD;
+    this->last_word_mask = (last_bit==BITS_PER_WORD-1) ? ~word(0) : ((word(1)<<(last_bit+1))-1);
+    this->words.assign(Y*N_PLANES*W,0);
+}
+
+unsigned int BitPlaneGrid::GetState(int x,int y) const
+{
+    unsigned int s = 0;
+    for(int p=0;p<N_PLANES;p++)
+        if((Row(y,p)[x/BITS_PER_WORD]>>(x%BITS_PER_WORD))&1)
+            s |= 1<<p;
+    return s;
+}
+
+void BitPlaneGrid::SetState(int x,int y,unsigned int s)
+{
+    const word bit = word(1)<<(x%BITS_PER_WORD);
+    for(int p=0;p<N_PLANES;p++)
+    {
+        word &w = Row(y,p)[x/BITS_PER_WORD];
+        if(s&(1<<p)) w |= bit;
+        else w &= ~bit;
+    }
+}
+
+void BitPlaneGrid::GetRowStates(int y,unsigned char *states) const
+{
+    const word *rows[8];
+    for(int p=0;p<N_PLANES;p++)
+        rows[p] = Row(y,p);
+    for(int x=0;x<X;x+=8)
+    {
+        // (the bytes of SPREAD have only their bottom bit set, so the planes can be shifted into place
+        // and combined a word at a time)
+        const int w = x/BITS_PER_WORD, shift = x%BITS_PER_WORD;
+        word v = 0;
+        for(int p=0;p<N_PLANES;p++)
+            v |= SPREAD.entries[(rows[p][w]>>shift)&0xFF] << p;
+        if(x+8<=X)
+            memcpy(states+x,&v,8);
+        else
+        {
+            unsigned char bytes[8];
+            memcpy(bytes,&v,8);
+            memcpy(states+x,bytes,X-x);
+        }
+    }
+}
+
+void BitPlaneGrid::SetRowStates(int y,const unsigned char *states)
+{
+    word *rows[8];
+    for(int p=0;p<N_PLANES;p++)
+    {
+        rows[p] = Row(y,p);
+        for(int w=0;w<W;w++)
+            rows[p][w] = 0;
+    }
+    for(int x=0;x<X;x+=8)
+    {
+        // gather bit p of each of 8 bytes into one byte: the multiply moves the bit of byte i to bit
+        // 56+i, with no carries into the top byte
+        const int w = x/BITS_PER_WORD, shift = x%BITS_PER_WORD;
+        word v = 0;
+        for(int i=0;i<8 && x+i<X;i++)
+            v |= word(states[x+i])<<(8*i);
+        for(int p=0;p<N_PLANES;p++)
+            rows[p][w] |= ((((v>>p)&0x0101010101010101ULL)*0x0102040810204080ULL)>>56) << shift;
+    }
+}
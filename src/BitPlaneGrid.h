@@ -0,0 +1,128 @@
+/*
+    Lattice Gas Explorer
+    Copyright (C) 2008-2009 Tim J. Hutton <tim.hutton@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BITPLANEGRID__
+#define __BITPLANEGRID__
+
+// standard library:
+#include <stdint.h>
+
+// STL:
+#include <vector>
+using std::vector;
+
+// A lattice stored as bit-planes ("multi-spin coding", see Wolf-Gladrow, 2000): plane p
+// holds bit p of the state of every cell, packed 64 cells to a word along each row. An
+// engine can then update 64 cells at once with word-wide boolean operations.
+class BitPlaneGrid
+{
+    public: // typedefs
+
+        typedef uint64_t word;
+        static const int BITS_PER_WORD = 64;
+
+    public: // functions
+
+        BitPlaneGrid();
+
+        // resize the grid to the specified size, leaving it empty
+        void Resize(int x_size,int y_size,int n_planes);
+
+        int GetX() const { return this->X; }
+        int GetY() const { return this->Y; }
+        int GetNumPlanes() const { return this->N_PLANES; }
+        int GetWordsPerRow() const { return this->W; }
+
+        // the bits of the last word in each row that lie inside the grid (the others are kept at zero)
+        word GetLastWordMask() const { return this->last_word_mask; }
+
+        // the W words that hold one plane of one row
+        word* Row(int y,int plane) { return &this->words[(y*this->N_PLANES+plane)*this->W]; }
+        const word* Row(int y,int plane) const { return &this->words[(y*this->N_PLANES+plane)*this->W]; }
+
+        // assemble or scatter the state of a single cell (slow: only for setup and display)
+        unsigned int GetState(int x,int y) const;
+        void SetState(int x,int y,unsigned int s);
+
+        // assemble or scatter the states of a whole row, one byte per cell (for up to 8 planes:
+        // this works on 8 cells at a time with word-wide bit transposes, so is much faster than
+        // GetState or SetState for each cell)
+        void GetRowStates(int y,unsigned char *states) const;
+        void SetRowStates(int y,const unsigned char *states);
+
+        // returns word w of a row, shifted so that each cell receives the bit of the cell
+        // on its left (the row wraps around)
+        word FromWest(const word* row,int w) const
+        {
+            word carry = (w>0) ? (row[w-1]>>63) : ((row[this->W-1]>>this->last_bit)&1);
+            return (row[w]<<1) | carry;
+        }
+
+        // returns word w of a row, shifted so that each cell receives the bit of the cell
+        // on its right (the row wraps around)
+        word FromEast(const word* row,int w) const
+        {
+            word v = row[w]>>1;
+            if(w<this->W-1) v |= row[w+1]<<63;
+            else v |= (row[0]&1)<<this->last_bit;
+            return v;
+        }
+
+        // returns word w of a row, shifted so that each cell receives the bit of the cell
+        // dx away from it (dx is -1, 0 or 1)
+        word FromOffset(const word* row,int dx,int w) const
+        {
+            if(dx<0) return FromWest(row,w);
+            else if(dx>0) return FromEast(row,w);
+            else return row[w];
+        }
+
+        // fill out with the W words of a row, shifted as by FromOffset (a row at a time, the words
+        // away from the ends need no checks, so this is much faster than calling FromOffset for each)
+        void ShiftRow(const word* row,int dx,word* out) const
+        {
+            const int W = this->W;
+            if(dx<0)
+            {
+                for(int w=1;w<W;w++)
+                    out[w] = (row[w]<<1) | (row[w-1]>>63);
+                out[0] = FromWest(row,0);
+            }
+            else if(dx>0)
+            {
+                for(int w=0;w<W-1;w++)
+                    out[w] = (row[w]>>1) | (row[w+1]<<63);
+                out[W-1] = FromEast(row,W-1);
+            }
+            else
+            {
+                for(int w=0;w<W;w++)
+                    out[w] = row[w];
+            }
+        }
+
+    protected: // data
+
+        int X,Y,N_PLANES;
+        int W; // words per row
+        int last_bit; // the position of cell X-1 in the last word of the row
+        word last_word_mask;
+        vector<word> words; // [y][plane][w]
+};
+
+#endif
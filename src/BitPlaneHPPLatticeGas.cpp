@@ -0,0 +1,137 @@
+/*
+    Lattice Gas Explorer
+    Copyright (C) 2008-2009 Tim J. Hutton <tim.hutton@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "BitPlaneHPPLatticeGas.h"
+
+using namespace std;
+
+BitPlaneHPPLatticeGas::BitPlaneHPPLatticeGas(HPP_type type) : HPPLatticeGas(type)
+{
+}
+
+void BitPlaneHPPLatticeGas::ResetGridForDemo(int i)
+{
+    // the demos are written into grid as usual, then we convert them
+    HPPLatticeGas::ResetGridForDemo(i);
+    PackGrid();
+}
+
+void BitPlaneHPPLatticeGas::ResetGridForGeometry(int x_size,int y_size,const vector<bool>& is_obstacle,bool wind_tunnel)
+{
+    HPPLatticeGas::ResetGridForGeometry(x_size,y_size,is_obstacle,wind_tunnel);
+    PackGrid();
+}
+
+void BitPlaneHPPLatticeGas::LoadCheckpoint(istream& in)
+{
+    HPPLatticeGas::LoadCheckpoint(in);
+    PackGrid();
+}
+
+void BitPlaneHPPLatticeGas::PackGrid()
+{
+    this->planes[0].Resize(X,Y,N_PLANES);
+    this->planes[1].Resize(X,Y,N_PLANES);
+    for(int y=0;y<Y;y++)
+        this->planes[current_buffer].SetRowStates(y,this->grid[current_buffer].Row(y));
+}
+
+void BitPlaneHPPLatticeGas::UpdateGas()
+{
+    typedef BitPlaneGrid::word word;
+
+    current_buffer = old_buffer;
+    old_buffer = 1-current_buffer;
+
+    const BitPlaneGrid &OldPlanes = this->planes[old_buffer];
+    BitPlaneGrid &NewPlanes = this->planes[current_buffer];
+    const int W = OldPlanes.GetWordsPerRow();
+    const word last_word_mask = OldPlanes.GetLastWordMask();
+
+    #pragma omp parallel for
+    for(int y=0;y<Y;y++)
+    {
+        // for each direction: which row, and which side, does an inbound particle come from?
+        const word *src[N_DIRS],*src_boundary[N_DIRS];
+        int src_dx[N_DIRS];
+        for(int dir=0;dir<N_DIRS;dir++)
+        {
+            const int sy = (y+DIR[opposite_dir(dir)][1]+Y)%Y;
+            src[dir] = OldPlanes.Row(sy,dir);
+            src_boundary[dir] = OldPlanes.Row(sy,BOUNDARY_PLANE);
+            src_dx[dir] = DIR[opposite_dir(dir)][0];
+        }
+        const word *c[N_PLANES];
+        word *out[N_PLANES];
+        for(int p=0;p<N_PLANES;p++)
+        {
+            c[p] = OldPlanes.Row(y,p);
+            out[p] = NewPlanes.Row(y,p);
+        }
+
+        word n[N_DIRS];
+        for(int w=0;w<W;w++)
+        {
+            const word boundary = c[BOUNDARY_PLANE][w];
+
+            // propagation
+            for(int dir=0;dir<N_DIRS;dir++)
+            {
+                const word in = OldPlanes.FromOffset(src[dir],src_dx[dir],w);
+                const word in_boundary = OldPlanes.FromOffset(src_boundary[dir],src_dx[dir],w);
+                // accept an inbound particle travelling in this direction, or if the neighbor
+                // is a boundary then reverse one of our own particles
+                n[dir] = (in & ~in_boundary) | (in_boundary & c[opposite_dir(dir)][w]);
+            }
+
+            // collisions: the only states that get swapped are 5 and 10 (see PermuteMaintainingMomentum),
+            // which between them flip all four bits
+            const word swap = (n[0] & ~n[1] & n[2] & ~n[3]) | (~n[0] & n[1] & ~n[2] & n[3]);
+
+            // boundary cells don't change, and the bits beyond the end of the row stay empty
+            word keep = ~boundary;
+            if(w==W-1) keep &= last_word_mask;
+            for(int dir=0;dir<N_DIRS;dir++)
+                out[dir][w] = (n[dir] ^ swap) & keep;
+            out[BOUNDARY_PLANE][w] = boundary;
+        }
+    }
+
+    if(force_flow)
+    {
+        vector<unsigned int> inflow(Y);
+        GetRandomColumn(Random_Inflow,0,0,Y,&inflow[0]);
+        for(int y=0;y<Y;y++)
+        {
+            // the left-most column gets overwritten randomly, since we are simulating
+            // an infinite tube filled with moving gas
+            if(OldPlanes.Row(y,BOUNDARY_PLANE)[0]&1) continue;
+            NewPlanes.SetState(0,y,this->forward_flow_samples[inflow[y]%this->forward_flow_samples.size()]);
+        }
+    }
+
+    this->iterations++;
+    this->need_recompute_flow = true;
+    this->n_changes++;
+}
+
+const BaseLatticeGas::state* BitPlaneHPPLatticeGas::GetStateRow(int y,state *buffer) const
+{
+    this->planes[current_buffer].GetRowStates(y,buffer);
+    return buffer;
+}
@@ -0,0 +1,59 @@
+/*
+    Lattice Gas Explorer
+    Copyright (C) 2008-2009 Tim J. Hutton <tim.hutton@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BITPLANEHPPLATTICEGAS__
+#define __BITPLANEHPPLATTICEGAS__
+
+#include "HPPLatticeGas.h"
+#include "BitPlaneGrid.h"
+
+// The same gas as HPPLatticeGas but stored as bit-planes, so that each step
+// updates 64 cells at a time with word shifts and a few boolean operations.
+class BitPlaneHPPLatticeGas : public HPPLatticeGas
+{
+    public:
+
+        BitPlaneHPPLatticeGas(HPP_type type);
+
+        void UpdateGas(); // override
+
+        void ResetGridForDemo(int i); // override
+        void ResetGridForGeometry(int x_size,int y_size,const vector<bool>& is_obstacle,bool wind_tunnel=true); // override
+        void LoadCheckpoint(istream& in); // override
+
+        double GetBytesPerCell() const { return N_PLANES/8.0; } // override
+
+    protected: // functions
+
+        bool CanUpdateRows() const { return false; } // override (we keep our cells in the bit-planes)
+
+        const state* GetStateRow(int y,state *buffer) const; // override
+
+        // copy the contents of grid[current_buffer] into the bit-planes
+        void PackGrid();
+
+    protected: // data
+
+        // the four direction bits get a plane each, plus one for the boundary (state 16)
+        static const int BOUNDARY_PLANE = 4;
+        static const int N_PLANES = 5;
+
+        BitPlaneGrid planes[2]; // indexed by current_buffer,old_buffer, as for grid
+};
+
+#endif
@@ -0,0 +1,477 @@
+/*
+    Lattice Gas Explorer
+    Copyright (C) 2008-2009 Tim J. Hutton <tim.hutton@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "BitSlicedCircuit.h"
+
+// STL:
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+using namespace std;
+
+namespace
+{
+    // While compiling, the circuit is a list of nodes, each a gate on earlier nodes (the first
+    // n_inputs nodes are the inputs). Asking for the same gate twice gives the same node.
+    class CircuitBuilder
+    {
+        public:
+
+            struct Node { int gate,a,b; };
+
+            CircuitBuilder(int n_inputs) : nodes(n_inputs) {} // (the gates of the inputs are never looked at)
+
+            // returns the node for gate(a,b), adding it if needed (for a gate with fewer operands, repeat one)
+            int Gate(int gate,int a,int b)
+            {
+                if(a>b) swap(a,b); // (all our gates are symmetric)
+                const pair<int,pair<int,int> > key(gate,make_pair(a,b));
+                map<pair<int,pair<int,int> >,int>::const_iterator found = this->made.find(key);
+                if(found!=this->made.end())
+                    return found->second;
+                const Node node = { gate,a,b };
+                this->nodes.push_back(node);
+                return this->made[key] = (int)this->nodes.size()-1;
+            }
+
+            vector<Node> nodes;
+
+        protected:
+
+            map<pair<int,pair<int,int> >,int> made;
+    };
+}
+
+BitSlicedCircuit::BitSlicedCircuit() : n_inputs(0), n_outputs(0), n_registers(0)
+{
+}
+
+void BitSlicedCircuit::Compile(int n_inputs,int n_outputs,const vector<unsigned int>& truth_table)
+{
+    if(n_inputs<1 || n_inputs>MAX_INPUTS || n_outputs<1 || n_outputs>MAX_OUTPUTS || truth_table.size()!=(1u<<n_inputs))
+        throw runtime_error("BitSlicedCircuit::Compile : unsupported number of inputs or outputs, or wrong size of truth table");
+
+    this->n_inputs = n_inputs;
+    this->n_outputs = n_outputs;
+
+    // first choose a sum of products for each output
+    vector<Implicant> products; // (all the different ones)
+    vector<unsigned int> users; // (bit j is set if output j uses that product)
+    for(int j=0;j<n_outputs;j++)
+    {
+        vector<unsigned int> minterms;
+        for(unsigned int i=0;i<truth_table.size();i++)
+            if(truth_table[i]&(1u<<j))
+                minterms.push_back(i);
+        if(minterms.empty())
+            continue;
+        // (the products chosen for the other outputs can be used too, if they fit inside this one, and cost less)
+        vector<Implicant> candidates = FindPrimeImplicants(minterms);
+        vector<int> costs;
+        for(int p=0;p<(int)candidates.size();p++)
+            costs.push_back(CountLiterals(n_inputs,candidates[p]));
+        for(int p=0;p<(int)products.size();p++)
+        {
+            const int found = (int)(find(candidates.begin(),candidates.end(),products[p])-candidates.begin());
+            if(found<(int)candidates.size())
+                costs[found] = 1;
+            else if(IsImplicant(products[p],truth_table,1u<<j))
+            {
+                candidates.push_back(products[p]);
+                costs.push_back(1);
+            }
+        }
+        const vector<Implicant> cover = FindCover(candidates,costs,minterms);
+        for(int iTerm=0;iTerm<(int)cover.size();iTerm++)
+        {
+            const int found = (int)(find(products.begin(),products.end(),cover[iTerm])-products.begin());
+            if(found<(int)products.size())
+                users[found] |= 1u<<j;
+            else
+            {
+                products.push_back(cover[iTerm]);
+                users.push_back(1u<<j);
+            }
+        }
+    }
+
+    // then build the circuit: the products that are used by the same set of outputs are added up just once,
+    // and then each output adds up the sums it needs (often a product is wanted by several outputs: in a
+    // collision of particles, for example, each change of state flips several bits)
+    CircuitBuilder builder(n_inputs);
+    map<unsigned int,int> sums; // (for each set of outputs, the sum of the products that just they use)
+    vector<unsigned int> sets(users);
+    sort(sets.begin(),sets.end());
+    sets.erase(unique(sets.begin(),sets.end()),sets.end());
+    for(int iSet=0;iSet<(int)sets.size();iSet++)
+    {
+        int sum = -1;
+        for(int iTerm=0;iTerm<(int)products.size();iTerm++)
+        {
+            if(users[iTerm]!=sets[iSet]) continue;
+            // (we make the product of each group of INPUT_GROUP inputs first, and then multiply those together:
+            // there are only a few different products of a group, so most of them can be shared)
+            int product = -1;
+            for(int k0=0;k0<n_inputs;k0+=INPUT_GROUP)
+            {
+                int group_product = -1;
+                for(int k=k0;k<min(n_inputs,k0+INPUT_GROUP);k++)
+                {
+                    if(products[iTerm].mask&(1u<<k)) continue;
+                    const int literal = (products[iTerm].value&(1u<<k)) ? k : builder.Gate(Gate_Not,k,k);
+                    group_product = (group_product<0) ? literal : builder.Gate(Gate_And,group_product,literal);
+                }
+                if(group_product>=0)
+                    product = (product<0) ? group_product : builder.Gate(Gate_And,product,group_product);
+            }
+            if(product<0) // (the output is always true)
+                product = builder.Gate(Gate_Not,builder.Gate(Gate_Zero,0,0),builder.Gate(Gate_Zero,0,0));
+            sum = (sum<0) ? product : builder.Gate(Gate_Or,sum,product);
+        }
+        sums[sets[iSet]] = sum;
+    }
+    vector<int> output_nodes(n_outputs,-1);
+    for(map<unsigned int,int>::const_iterator it=sums.begin();it!=sums.end();it++)
+        for(int j=0;j<n_outputs;j++)
+            if(it->first&(1u<<j))
+                output_nodes[j] = (output_nodes[j]<0) ? it->second : builder.Gate(Gate_Or,output_nodes[j],it->second);
+    for(int j=0;j<n_outputs;j++)
+        if(output_nodes[j]<0)
+            output_nodes[j] = builder.Gate(Gate_Zero,0,0);
+
+    // turn the nodes into a program: every instruction can invert its operands and its result (an OR is the
+    // inverse of an AND of the inverses) so the NOTs cost nothing, and a register is reused once nothing needs it
+    const vector<CircuitBuilder::Node> &nodes = builder.nodes;
+    const int n_nodes = (int)nodes.size();
+    vector<int> base(n_nodes); // (which instruction or input each node is the value of, or the inverse of)
+    vector<bool> inverted(n_nodes,false);
+    for(int i=0;i<n_nodes;i++)
+    {
+        base[i] = i;
+        if(i>=n_inputs && nodes[i].gate==Gate_Not)
+        {
+            base[i] = base[nodes[i].a];
+            inverted[i] = !inverted[nodes[i].a];
+        }
+    }
+    vector<int> last_use(n_nodes,-1);
+    for(int i=n_inputs;i<n_nodes;i++)
+    {
+        if(base[i]!=i) continue;
+        last_use[base[nodes[i].a]] = i;
+        last_use[base[nodes[i].b]] = i;
+    }
+    for(int j=0;j<n_outputs;j++)
+        last_use[base[output_nodes[j]]] = n_nodes;
+    vector<int> operand(n_nodes);
+    for(int k=0;k<n_inputs;k++)
+        operand[k] = -1-k;
+    vector<int> free_registers;
+    this->program.clear();
+    this->n_registers = 0;
+    for(int i=n_inputs;i<n_nodes;i++)
+    {
+        if(base[i]!=i || last_use[i]<0) continue; // (a NOT, or nothing needs it)
+        const int a = nodes[i].a,b = nodes[i].b;
+        Instruction instruction;
+        instruction.a = operand[base[a]];
+        instruction.b = operand[base[b]];
+        instruction.invert_a = inverted[a] ? ~(word)0 : 0;
+        instruction.invert_b = inverted[b] ? ~(word)0 : 0;
+        instruction.invert_out = 0;
+        switch(nodes[i].gate)
+        {
+            case Gate_Zero: // (x AND NOT x, for an input x)
+                instruction.invert_a = 0;
+                instruction.invert_b = ~(word)0;
+                break;
+            case Gate_Or:
+                instruction.invert_a = ~instruction.invert_a;
+                instruction.invert_b = ~instruction.invert_b;
+                instruction.invert_out = ~(word)0;
+                break;
+            default: // (Gate_And needs no changes)
+                break;
+        }
+        // (the result never goes over an operand, so that the compiler can vectorize Evaluate)
+        if(free_registers.empty())
+            instruction.out = this->n_registers++;
+        else
+        {
+            instruction.out = free_registers.back();
+            free_registers.pop_back();
+        }
+        if(base[a]>=n_inputs && last_use[base[a]]==i)
+            free_registers.push_back(operand[base[a]]);
+        if(base[b]>=n_inputs && base[b]!=base[a] && last_use[base[b]]==i)
+            free_registers.push_back(operand[base[b]]);
+        operand[i] = instruction.out;
+        this->program.push_back(instruction);
+    }
+    this->output_operands.resize(n_outputs);
+    this->output_inversions.resize(n_outputs);
+    for(int j=0;j<n_outputs;j++)
+    {
+        this->output_operands[j] = operand[base[output_nodes[j]]];
+        this->output_inversions[j] = inverted[output_nodes[j]] ? ~(word)0 : 0;
+    }
+
+    if(!Matches(truth_table))
+        throw runtime_error("BitSlicedCircuit::Compile : the circuit doesn't match the truth table");
+}
+
+bool BitSlicedCircuit::Matches(const vector<unsigned int>& truth_table) const
+{
+    if(truth_table.size()!=(1u<<this->n_inputs))
+        return false;
+
+    // evaluate every input at once: bit i of input plane k is bit k of i
+    const int n_words = (int)((truth_table.size()+63)/64);
+    const int padded = GetPaddedSize(n_words);
+    vector<word> in_planes(this->n_inputs*padded,0),out_planes(this->n_outputs*padded,0),scratch;
+    vector<const word*> inputs(this->n_inputs);
+    vector<word*> outputs(this->n_outputs);
+    for(int k=0;k<this->n_inputs;k++)
+    {
+        inputs[k] = &in_planes[k*padded];
+        for(unsigned int i=0;i<truth_table.size();i++)
+            if(i&(1u<<k))
+                in_planes[k*padded+i/64] |= (word)1<<(i%64);
+    }
+    for(int j=0;j<this->n_outputs;j++)
+        outputs[j] = &out_planes[j*padded];
+    Evaluate(&inputs[0],&outputs[0],n_words,scratch);
+
+    for(unsigned int i=0;i<truth_table.size();i++)
+        for(int j=0;j<this->n_outputs;j++)
+            if(((out_planes[j*padded+i/64]>>(i%64))&1) != ((truth_table[i]>>j)&1))
+                return false;
+    return true;
+}
+
+vector<BitSlicedCircuit::Implicant> BitSlicedCircuit::FindPrimeImplicants(const vector<unsigned int>& minterms)
+{
+    // start with the minterms, and merge pairs that differ in just one input until no more can be merged:
+    // anything that couldn't be merged is a prime implicant (kept as mask,value so that sorting groups by mask)
+    vector<pair<unsigned int,unsigned int> > current;
+    for(int i=0;i<(int)minterms.size();i++)
+        current.push_back(make_pair(0u,minterms[i]));
+    sort(current.begin(),current.end());
+    current.erase(unique(current.begin(),current.end()),current.end());
+
+    vector<Implicant> primes;
+    while(!current.empty())
+    {
+        vector<bool> merged(current.size(),false);
+        vector<pair<unsigned int,unsigned int> > next;
+        for(int i=0;i<(int)current.size();i++)
+        {
+            // (only implicants with the same mask can merge, and they are next to each other)
+            for(int j=i+1;j<(int)current.size() && current[j].first==current[i].first;j++)
+            {
+                const unsigned int diff = current[i].second ^ current[j].second;
+                if(diff&(diff-1)) continue;
+                next.push_back(make_pair(current[i].first|diff,current[i].second&~diff));
+                merged[i] = merged[j] = true;
+            }
+            if(!merged[i])
+            {
+                Implicant prime = { current[i].second,current[i].first };
+                primes.push_back(prime);
+            }
+        }
+        sort(next.begin(),next.end());
+        next.erase(unique(next.begin(),next.end()),next.end());
+        current.swap(next);
+    }
+    return primes;
+}
+
+int BitSlicedCircuit::CountLiterals(int n_inputs,const Implicant& term)
+{
+    int n = 0;
+    for(unsigned int bits=~term.mask&((1u<<n_inputs)-1);bits;bits&=bits-1)
+        n++;
+    return n;
+}
+
+bool BitSlicedCircuit::IsImplicant(const Implicant& term,const vector<unsigned int>& truth_table,unsigned int output_bit)
+{
+    // (we visit each input that term covers by counting through the subsets of its mask)
+    unsigned int subset = 0;
+    do
+    {
+        if(!(truth_table[term.value|subset]&output_bit))
+            return false;
+        subset = (subset-term.mask)&term.mask;
+    } while(subset!=0);
+    return true;
+}
+
+vector<BitSlicedCircuit::Implicant> BitSlicedCircuit::FindCover(const vector<Implicant>& candidates,const vector<int>& costs,
+    const vector<unsigned int>& minterms)
+{
+    const int n_candidates = (int)candidates.size();
+    const int n_minterms = (int)minterms.size();
+    vector<vector<bool> > covers(n_candidates,vector<bool>(n_minterms));
+    for(int p=0;p<n_candidates;p++)
+        for(int m=0;m<n_minterms;m++)
+            covers[p][m] = (minterms[m]&~candidates[p].mask)==candidates[p].value;
+
+    vector<bool> chosen(n_candidates,false),covered(n_minterms,false);
+    int n_uncovered = n_minterms;
+
+    // first the essential ones: those that are the only one to cover some minterm
+    for(int m=0;m<n_minterms;m++)
+    {
+        int only = -1,n_covering = 0;
+        for(int p=0;p<n_candidates;p++)
+            if(covers[p][m]) { only = p; n_covering++; }
+        if(n_covering==1)
+            chosen[only] = true;
+    }
+    for(int p=0;p<n_candidates;p++)
+        if(chosen[p])
+            for(int m=0;m<n_minterms;m++)
+                if(covers[p][m] && !covered[m]) { covered[m] = true; n_uncovered--; }
+
+    // then repeatedly take the one that covers the most of what is left for its cost
+    while(n_uncovered>0)
+    {
+        int best = -1,best_count = 0,best_cost = 1;
+        for(int p=0;p<n_candidates;p++)
+        {
+            if(chosen[p]) continue;
+            int count = 0;
+            for(int m=0;m<n_minterms;m++)
+                if(covers[p][m] && !covered[m])
+                    count++;
+            if(count*best_cost > best_count*costs[p])
+            {
+                best = p;
+                best_count = count;
+                best_cost = costs[p];
+            }
+        }
+        chosen[best] = true;
+        for(int m=0;m<n_minterms;m++)
+            if(covers[best][m] && !covered[m]) { covered[m] = true; n_uncovered--; }
+    }
+
+    vector<Implicant> cover;
+    for(int p=0;p<n_candidates;p++)
+        if(chosen[p])
+            cover.push_back(candidates[p]);
+    return cover;
+}
+
+void BitSlicedCircuit::Evaluate(const word* const* inputs,word* const* outputs,int n_words,vector<word>& scratch) const
+{
+    if((int)scratch.size()<this->n_registers*WORDS_PER_PASS)
+        scratch.resize(this->n_registers*WORDS_PER_PASS);
+    word *registers = scratch.empty() ? NULL : &scratch[0];
+    const int N = WORDS_PER_PASS; // (a constant, so that the compiler can vectorize each gate completely)
+
+    for(int w0=0;w0<n_words;w0+=N)
+    {
+        for(int i=0;i<(int)this->program.size();i++)
+        {
+            const Instruction &instruction = this->program[i];
+            word *d = registers + instruction.out*N;
+            const word *a = (instruction.a<0) ? inputs[-1-instruction.a]+w0 : registers + instruction.a*N;
+            const word *b = (instruction.b<0) ? inputs[-1-instruction.b]+w0 : registers + instruction.b*N;
+            const word invert_a = instruction.invert_a,invert_b = instruction.invert_b,invert_out = instruction.invert_out;
+            for(int k=0;k<N;k++)
+                d[k] = ((a[k]^invert_a) & (b[k]^invert_b)) ^ invert_out;
+        }
+        for(int j=0;j<this->n_outputs;j++)
+        {
+            const int op = this->output_operands[j];
+            const word *r = (op<0) ? inputs[-1-op]+w0 : registers + op*N;
+            const word invert = this->output_inversions[j];
+            word *o = outputs[j]+w0;
+            for(int k=0;k<N;k++)
+                o[k] = r[k]^invert;
+        }
+    }
+}
+
+string BitSlicedCircuit::GetOperandCode(const string& variable,word invert)
+{
+    return invert ? "~"+variable : variable;
+}
+
+void BitSlicedCircuit::WriteCode(ostream& out,const string& name) const
+{
+    // each instruction gets a variable of its own (rather than reusing the registers), which leaves
+    // it to the compiler to decide what stays in a register
+    vector<string> inputs(this->n_inputs),registers(this->n_registers);
+    for(int k=0;k<this->n_inputs;k++)
+    {
+        ostringstream oss;
+        oss << "i" << k;
+        inputs[k] = oss.str();
+    }
+    // (not every input need be used, and unused ones would draw warnings)
+    vector<bool> used(this->n_inputs,false);
+    for(int i=0;i<(int)this->program.size();i++)
+    {
+        if(this->program[i].a<0) used[-1-this->program[i].a] = true;
+        if(this->program[i].b<0) used[-1-this->program[i].b] = true;
+    }
+    for(int j=0;j<this->n_outputs;j++)
+        if(this->output_operands[j]<0) used[-1-this->output_operands[j]] = true;
+
+    out << "// " << this->n_inputs << " inputs, " << this->n_outputs << " outputs, " << this->program.size() << " gates\n";
+    out << "static void " << name << "(const BitSlicedCircuit::word* const* inputs,BitSlicedCircuit::word* const* outputs,int n_words)\n";
+    out << "{\n";
+    out << "    typedef BitSlicedCircuit::word word;\n";
+    for(int k=0;k<this->n_inputs;k++)
+        if(used[k])
+            out << "    const word *in" << k << " = inputs[" << k << "];\n";
+    for(int j=0;j<this->n_outputs;j++)
+        out << "    word *out" << j << " = outputs[" << j << "];\n";
+    out << "    #pragma omp simd\n";
+    out << "    for(int w=0;w<n_words;w++)\n";
+    out << "    {\n";
+    for(int k=0;k<this->n_inputs;k++)
+        if(used[k])
+            out << "        const word " << inputs[k] << " = in" << k << "[w];\n";
+    for(int i=0;i<(int)this->program.size();i++)
+    {
+        const Instruction &instruction = this->program[i];
+        const string &a = (instruction.a<0) ? inputs[-1-instruction.a] : registers[instruction.a];
+        const string &b = (instruction.b<0) ? inputs[-1-instruction.b] : registers[instruction.b];
+        ostringstream expression;
+        expression << "(" << GetOperandCode(a,instruction.invert_a) << " & " << GetOperandCode(b,instruction.invert_b) << ")";
+        ostringstream variable;
+        variable << "t" << i;
+        out << "        const word " << variable.str() << " = " << GetOperandCode(expression.str(),instruction.invert_out) << ";\n";
+        registers[instruction.out] = variable.str();
+    }
+    for(int j=0;j<this->n_outputs;j++)
+    {
+        const int op = this->output_operands[j];
+        const string &r = (op<0) ? inputs[-1-op] : registers[op];
+        out << "        out" << j << "[w] = " << GetOperandCode(r,this->output_inversions[j]) << ";\n";
+    }
+    out << "    }\n";
+    out << "}\n";
+}
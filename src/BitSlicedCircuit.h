@@ -0,0 +1,131 @@
+/*
+    Lattice Gas Explorer
+    Copyright (C) 2008-2009 Tim J. Hutton <tim.hutton@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BITSLICEDCIRCUIT__
+#define __BITSLICEDCIRCUIT__
+
+// standard library:
+#include <stdint.h>
+
+// STL:
+#include <vector>
+#include <string>
+#include <ostream>
+using std::vector;
+using std::string;
+using std::ostream;
+
+// A boolean function of a few input bits, compiled into a small circuit of AND, OR and NOT
+// gates that is applied to bit-planes (see BitPlaneGrid), so that each gate works on 64 cells
+// per word. This lets an engine run a gas's rules without having them written out by hand:
+// describe the rules as a truth table, and Compile finds a small sum of products for each
+// output bit (Quine-McCluskey), sharing what it can between the outputs. Evaluate then runs
+// the circuit as a list of instructions, each over a block of words.
+class BitSlicedCircuit
+{
+    public: // typedefs
+
+        typedef uint64_t word;
+        static const int MAX_INPUTS = 16;
+        static const int MAX_OUTPUTS = 32;
+
+        // the circuit is evaluated this many words at a time, so that the registers stay in the cache
+        static const int WORDS_PER_PASS = 64;
+
+    public: // functions
+
+        BitSlicedCircuit();
+
+        // build the circuit for a function of n_inputs bits with n_outputs bits: bit j of
+        // truth_table[i] is output j when input k is bit k of i (so there are 2^n_inputs entries)
+        // (throws runtime_error if the circuit built doesn't match the truth table)
+        void Compile(int n_inputs,int n_outputs,const vector<unsigned int>& truth_table);
+
+        // apply the circuit to n_words words of each plane: inputs[k] points to the words of input k,
+        // and outputs[j] to where output j goes (scratch is for the intermediate planes, and is
+        // enlarged as needed: give each thread its own). The words are done WORDS_PER_PASS at a time,
+        // so every plane must have room for GetPaddedSize(n_words) words (the extra outputs are junk).
+        void Evaluate(const word* const* inputs,word* const* outputs,int n_words,vector<word>& scratch) const;
+
+        static int GetPaddedSize(int n_words) { return (n_words+WORDS_PER_PASS-1)/WORDS_PER_PASS*WORDS_PER_PASS; }
+
+        // does the circuit give the truth table's outputs for every one of its inputs? (Compile checks
+        // this before it returns, so that a fault in the minimization can't reach a gas unnoticed)
+        bool Matches(const vector<unsigned int>& truth_table) const;
+
+        // write the circuit out as a C++ function with the given name, that does the same as Evaluate
+        // but as straight-line code, one word at a time, so that the compiler can keep the intermediate
+        // values in registers and vectorize the loop over the words (see lga_generate_kernels.cpp):
+        //     static void name(const word* const* inputs,word* const* outputs,int n_words)
+        // (the planes need no padding)
+        void WriteCode(ostream& out,const string& name) const;
+
+        int GetNumInputs() const { return this->n_inputs; }
+        int GetNumOutputs() const { return this->n_outputs; }
+
+        // how many instructions does the circuit take? (a measure of the work per word)
+        int GetNumInstructions() const { return (int)this->program.size(); }
+
+    protected: // typedefs
+
+        // a product of some of the inputs and their inverses: the inputs whose bits are set in
+        // mask don't appear, and the others must equal their bit in value
+        struct Implicant
+        {
+            unsigned int value,mask;
+            bool operator==(const Implicant& other) const { return value==other.value && mask==other.mask; }
+        };
+
+        enum TGate { Gate_Zero, Gate_Not, Gate_And, Gate_Or };
+
+        // (an operand, as WriteCode writes it: its variable, inverted if invert is set)
+        static string GetOperandCode(const string& variable,word invert);
+
+        // an instruction sets register out to ((a^invert_a) & (b^invert_b)) ^ invert_out, which can be any of
+        // the gates, with no branches (operands: 0 or more is a register, -1-k is input k)
+        struct Instruction { int a,b,out; word invert_a,invert_b,invert_out; };
+
+    protected: // functions
+
+        // the prime implicants of the function that is true for the given inputs
+        static vector<Implicant> FindPrimeImplicants(const vector<unsigned int>& minterms);
+
+        // a cheap set of the candidate implicants that between them cover all the minterms, where each
+        // candidate has a cost (the number of gates it would add to the circuit)
+        static vector<Implicant> FindCover(const vector<Implicant>& candidates,const vector<int>& costs,
+            const vector<unsigned int>& minterms);
+
+        // the number of inputs that appear in term
+        static int CountLiterals(int n_inputs,const Implicant& term);
+
+        // is every input that term covers one where the given output bit of the truth table is set?
+        static bool IsImplicant(const Implicant& term,const vector<unsigned int>& truth_table,unsigned int output_bit);
+
+    protected: // data
+
+        // the products are built from products of this many neighboring inputs (see Compile)
+        static const int INPUT_GROUP = 3;
+
+        int n_inputs,n_outputs;
+        int n_registers;
+        vector<Instruction> program;
+        vector<int> output_operands; // where each output ends up
+        vector<word> output_inversions; // (and whether it has to be inverted)
+};
+
+#endif
@@ -0,0 +1,222 @@
+/*
+    Lattice Gas Explorer
+    Copyright (C) 2008-2009 Tim J. Hutton <tim.hutton@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BYTEVECTOR__
+#define __BYTEVECTOR__
+
+// A thin wrapper over the widest byte-vector instruction set the compiler has been told it can
+// use (AVX-512 VBMI, AVX2 or SSSE3), so that the kernels can be written once. If none of these
+// are available then HAVE_BYTE_VECTOR is left undefined and the kernels fall back to scalar code.
+
+// standard library:
+#include <stdint.h>
+
+#if defined(__AVX512BW__) && defined(__AVX512VBMI__)
+
+#include <immintrin.h>
+#define HAVE_BYTE_VECTOR
+
+class ByteVector
+{
+    public:
+
+        typedef __m512i type;
+        static const int WIDTH = 64;
+
+        // a 128-entry byte table, ready for Lookup
+        struct Table128 { type t[2]; };
+
+        static type Load(const unsigned char *p) { return _mm512_loadu_si512((const void*)p); }
+        static void Store(unsigned char *p,type v) { _mm512_storeu_si512((void*)p,v); }
+        static type Set1(unsigned char c) { return _mm512_set1_epi8((char)c); }
+        static type And(type a,type b) { return _mm512_and_si512(a,b); }
+        static type Or(type a,type b) { return _mm512_or_si512(a,b); }
+        static type Equal(type a,type b) { return _mm512_movm_epi8(_mm512_cmpeq_epi8_mask(a,b)); }
+        // mask ? a : b, where each byte of mask is 0x00 or 0xFF
+        static type Select(type mask,type a,type b) { return _mm512_ternarylogic_epi32(mask,a,b,0xCA); }
+
+        static void LoadTable128(const unsigned char *table,Table128 &t)
+        {
+            t.t[0] = Load(table);
+            t.t[1] = Load(table+64);
+        }
+        // returns table[i] for each byte i (which must be less than N_ENTRIES: 64 or 128)
+        template<int N_ENTRIES> static type Lookup(const Table128 &t,type i) 
+        { 
+            if(N_ENTRIES<=64) 
+                return _mm512_permutexvar_epi8(i,t.t[0]);
+            return _mm512_permutex2var_epi8(t.t[0],i,t.t[1]); 
+        }
+
+        // returns t[c][i] for each byte i, where c (0-3) is 1 if that byte of c1 is set, plus 2 if that byte of c2 is set
+        template<int N_ENTRIES> static type LookupX4(const Table128 *t,type i,type c1,type c2)
+        {
+            const type low = Select(c1,Lookup<N_ENTRIES>(t[1],i),Lookup<N_ENTRIES>(t[0],i));
+            const type high = Select(c1,Lookup<N_ENTRIES>(t[3],i),Lookup<N_ENTRIES>(t[2],i));
+            return Select(c2,high,low);
+        }
+
+        // returns a mask with byte b set if bit b of bits is set
+        static type MaskFromBits(uint64_t bits) { return _mm512_movm_epi8((__mmask64)bits); }
+
+        // the other way around: bit b is set if byte b of mask is set
+        static uint64_t BitsFromMask(type mask) { return (uint64_t)_mm512_movepi8_mask(mask); }
+};
+
+#elif defined(__AVX2__)
+
+#include <immintrin.h>
+#define HAVE_BYTE_VECTOR
+
+class ByteVector
+{
+    public:
+
+        typedef __m256i type;
+        static const int WIDTH = 32;
+
+        // a 128-entry byte table, ready for Lookup
+        struct Table128 { type t[8]; };
+
+        static type Load(const unsigned char *p) { return _mm256_loadu_si256((const __m256i*)p); }
+        static void Store(unsigned char *p,type v) { _mm256_storeu_si256((__m256i*)p,v); }
+        static type Set1(unsigned char c) { return _mm256_set1_epi8((char)c); }
+        static type And(type a,type b) { return _mm256_and_si256(a,b); }
+        static type Or(type a,type b) { return _mm256_or_si256(a,b); }
+        static type Equal(type a,type b) { return _mm256_cmpeq_epi8(a,b); }
+        // mask ? a : b, where each byte of mask is 0x00 or 0xFF
+        static type Select(type mask,type a,type b) { return _mm256_blendv_epi8(b,a,mask); }
+
+        static void LoadTable128(const unsigned char *table,Table128 &t)
+        {
+            // (the byte shuffle works within each 128-bit half, so each 16 entries are repeated in both)
+            for(int k=0;k<8;k++)
+                t.t[k] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)(table+16*k)));
+        }
+        // returns table[i] for each byte i (which must be less than N_ENTRIES: 64 or 128)
+        template<int N_ENTRIES> static type Lookup(const Table128 &t,type i)
+        {
+            // each shuffle looks up the low 4 bits; we keep the one whose 16 entries match the high bits
+            const type high = And(i,Set1(0x70));
+            type r = _mm256_setzero_si256();
+            for(int k=0;k<N_ENTRIES/16;k++)
+                r = Or(r,And(Equal(high,Set1((unsigned char)(k<<4))),_mm256_shuffle_epi8(t.t[k],i)));
+            return r;
+        }
+
+        // returns t[c][i] for each byte i, where c (0-3) is 1 if that byte of c1 is set, plus 2 if that byte of c2 is set
+        template<int N_ENTRIES> static type LookupX4(const Table128 *t,type i,type c1,type c2)
+        {
+            // as for Lookup, but we pick between the four tables before keeping the matching entries
+            const type high = And(i,Set1(0x70));
+            type r = _mm256_setzero_si256();
+            for(int k=0;k<N_ENTRIES/16;k++)
+            {
+                const type low = Select(c1,_mm256_shuffle_epi8(t[1].t[k],i),_mm256_shuffle_epi8(t[0].t[k],i));
+                const type high_tables = Select(c1,_mm256_shuffle_epi8(t[3].t[k],i),_mm256_shuffle_epi8(t[2].t[k],i));
+                r = Or(r,And(Equal(high,Set1((unsigned char)(k<<4))),Select(c2,high_tables,low)));
+            }
+            return r;
+        }
+
+        // returns a mask with byte b set if bit b of bits is set
+        static type MaskFromBits(uint64_t bits)
+        {
+            // copy byte b/8 of bits into each byte b, then test the bit in each
+            const type spread = _mm256_shuffle_epi8(_mm256_set1_epi32((int)(uint32_t)bits),
+                _mm256_setr_epi8(0,0,0,0,0,0,0,0,1,1,1,1,1,1,1,1,2,2,2,2,2,2,2,2,3,3,3,3,3,3,3,3));
+            const type bit = _mm256_set1_epi64x((long long)0x8040201008040201ULL);
+            return Equal(And(spread,bit),bit);
+        }
+
+        // the other way around: bit b is set if byte b of mask is set
+        static uint64_t BitsFromMask(type mask) { return (uint32_t)_mm256_movemask_epi8(mask); }
+};
+
+#elif defined(__SSSE3__)
+
+#include <tmmintrin.h>
+#define HAVE_BYTE_VECTOR
+
+class ByteVector
+{
+    public:
+
+        typedef __m128i type;
+        static const int WIDTH = 16;
+
+        // a 128-entry byte table, ready for Lookup
+        struct Table128 { type t[8]; };
+
+        static type Load(const unsigned char *p) { return _mm_loadu_si128((const __m128i*)p); }
+        static void Store(unsigned char *p,type v) { _mm_storeu_si128((__m128i*)p,v); }
+        static type Set1(unsigned char c) { return _mm_set1_epi8((char)c); }
+        static type And(type a,type b) { return _mm_and_si128(a,b); }
+        static type Or(type a,type b) { return _mm_or_si128(a,b); }
+        static type Equal(type a,type b) { return _mm_cmpeq_epi8(a,b); }
+        // mask ? a : b, where each byte of mask is 0x00 or 0xFF
+        static type Select(type mask,type a,type b) { return _mm_or_si128(_mm_and_si128(mask,a),_mm_andnot_si128(mask,b)); }
+
+        static void LoadTable128(const unsigned char *table,Table128 &t)
+        {
+            for(int k=0;k<8;k++)
+                t.t[k] = Load(table+16*k);
+        }
+        // returns table[i] for each byte i (which must be less than N_ENTRIES: 64 or 128)
+        template<int N_ENTRIES> static type Lookup(const Table128 &t,type i)
+        {
+            // each shuffle looks up the low 4 bits; we keep the one whose 16 entries match the high bits
+            const type high = And(i,Set1(0x70));
+            type r = _mm_setzero_si128();
+            for(int k=0;k<N_ENTRIES/16;k++)
+                r = Or(r,And(Equal(high,Set1((unsigned char)(k<<4))),_mm_shuffle_epi8(t.t[k],i)));
+            return r;
+        }
+
+        // returns t[c][i] for each byte i, where c (0-3) is 1 if that byte of c1 is set, plus 2 if that byte of c2 is set
+        template<int N_ENTRIES> static type LookupX4(const Table128 *t,type i,type c1,type c2)
+        {
+            // as for Lookup, but we pick between the four tables before keeping the matching entries
+            const type high = And(i,Set1(0x70));
+            type r = _mm_setzero_si128();
+            for(int k=0;k<N_ENTRIES/16;k++)
+            {
+                const type low = Select(c1,_mm_shuffle_epi8(t[1].t[k],i),_mm_shuffle_epi8(t[0].t[k],i));
+                const type high_tables = Select(c1,_mm_shuffle_epi8(t[3].t[k],i),_mm_shuffle_epi8(t[2].t[k],i));
+                r = Or(r,And(Equal(high,Set1((unsigned char)(k<<4))),Select(c2,high_tables,low)));
+            }
+            return r;
+        }
+
+        // returns a mask with byte b set if bit b of bits is set
+        static type MaskFromBits(uint64_t bits)
+        {
+            // copy byte b/8 of bits into each byte b, then test the bit in each
+            const type spread = _mm_shuffle_epi8(_mm_set1_epi16((short)(uint16_t)bits),
+                _mm_setr_epi8(0,0,0,0,0,0,0,0,1,1,1,1,1,1,1,1));
+            const type bit = _mm_set1_epi64x((long long)0x8040201008040201ULL);
+            return Equal(And(spread,bit),bit);
+        }
+
+        // the other way around: bit b is set if byte b of mask is set
+        static uint64_t BitsFromMask(type mask) { return (uint16_t)_mm_movemask_epi8(mask); }
+};
+
+#endif
+
+#endif
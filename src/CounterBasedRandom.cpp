@@ -16,16 +16,10 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#ifndef __SQUAREGRIDLATTICEGAS__
-#define __SQUAREGRIDLATTICEGAS__
+#include "CounterBasedRandom.h"
 
-#include "BaseLatticeGas_drawable.h"
-
-class SquareGridLatticeGas : public BaseLatticeGas_drawable
+void CounterBasedRandom::Fill(uint32_t c0,uint32_t c1,uint32_t c2,uint32_t c3,int d0,int d1,int n,uint32_t *out) const
 {
-    public:
-
-        void RedrawImagesIfNeeded();
-};
-
-#endif
+    for(int i=0;i<n;i++)
+        out[i] = Get(c0+(uint32_t)(i*d0),c1+(uint32_t)(i*d1),c2,c3);
+}
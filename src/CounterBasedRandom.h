@@ -0,0 +1,71 @@
+/*
+    Lattice Gas Explorer
+    Copyright (C) 2008-2009 Tim J. Hutton <tim.hutton@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __COUNTERBASEDRANDOM__
+#define __COUNTERBASEDRANDOM__
+
+// standard library:
+#include <stdint.h>
+
+// A counter-based random number generator (Philox4x32-10, see Salmon et al., 2011: "Parallel
+// random numbers: as easy as 1, 2, 3"). Each number is a fixed function of the seed and a
+// counter of four 32-bit values, so there is no state to share: any thread can ask for any
+// number, in any order, and will get the same answer.
+class CounterBasedRandom
+{
+    public:
+
+        CounterBasedRandom(uint32_t seed=0) : seed(seed) {}
+
+        void SetSeed(uint32_t s) { this->seed = s; }
+        uint32_t GetSeed() const { return this->seed; }
+
+        // returns a random number for the counter c0,c1,c2,c3
+        uint32_t Get(uint32_t c0,uint32_t c1,uint32_t c2,uint32_t c3) const
+        {
+            uint32_t k0 = this->seed, k1 = KEY1;
+            for(int round=0;round<10;round++)
+            {
+                const uint64_t p0 = (uint64_t)M0 * c0;
+                const uint64_t p1 = (uint64_t)M1 * c2;
+                const uint32_t n0 = (uint32_t)(p1>>32) ^ c1 ^ k0;
+                const uint32_t n2 = (uint32_t)(p0>>32) ^ c3 ^ k1;
+                c1 = (uint32_t)p1;
+                c3 = (uint32_t)p0;
+                c0 = n0;
+                c2 = n2;
+                k0 += W0;
+                k1 += W1;
+            }
+            return c0;
+        }
+
+        // sets out[i] = Get(c0+i*d0,c1+i*d1,c2,c3) for i from 0 to n-1 (the loop has no
+        // dependencies between iterations, so the compiler can vectorize it)
+        void Fill(uint32_t c0,uint32_t c1,uint32_t c2,uint32_t c3,int d0,int d1,int n,uint32_t *out) const;
+
+    protected:
+
+        static const uint32_t M0 = 0xD2511F53, M1 = 0xCD9E8D57; // multipliers
+        static const uint32_t W0 = 0x9E3779B9, W1 = 0xBB67AE85; // key increments
+        static const uint32_t KEY1 = 0x4C617474; // (the seed is the other half of the key)
+
+        uint32_t seed;
+};
+
+#endif
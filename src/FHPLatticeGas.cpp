@@ -17,149 +17,214 @@
 */
 
 #include "FHPLatticeGas.h"
+#include "ByteVector.h"
 
 // STL:
-#include <stdexcept>
-#include <exception>
 #include <sstream>
+#include <algorithm>
+#include <stdexcept>
 using namespace std;
 
-// simple helper function: takes n states and assembles them into a vector<state>
-vector<BaseLatticeGas::state> FHPLatticeGas::Vec(int n, ...)
-{
-    va_list ap;
-    int j;
-    vector<state> v;
-    va_start(ap, n); // Requires the last fixed parameter (to get the address)
-    for(j=0; j<n; j++) v.push_back(va_arg(ap,int)); // (increments ap)
-    // (va_arg requires the type to cast to, but gcc warns that state
-    //  (currently unsigned char) gets promoted to int anyway, so we use int
-    //  and let it get cast back to state on insertion into v.)
-    va_end(ap);
-    return v;
+// We're following:
+// [1] Wylie, 1990:       http://pages.cs.wisc.edu/~wylie/doc/PhD_thesis.pdf
+// [2] Arai et al., 2007: http://www.fz-juelich.de/nic-series/volume38/arai.pdf
+// (see also: [3] Wolf-Gladrow, 2000: http://epic.awi.de/Publications/Wol2000c.pdf)
+
+// N.B. Interestingly, [2] and [3] seem to miss out several FHP collisions,
+//  e.g. [2] has REST+NE+SE+W and NW+NE+SW+SE in different classes, likewise E+W+REST and NE+SE+W
+//  (also in [2] the last transition in Fig. 6 is misprinted (mass conservation error) and again in 
+//   Procedure 3 in Fig. 7)
+//  e.g. [3] misses NE+SE+W <-> E+W+REST
+
+// A "collision class" [2] is a set of states that can be swapped at will, without
+// affecting the mass or momentum of that node. For best results, a gas should be
+// "collision-saturated" - it swaps everything that can be swapped.
+
+// these are some possible collision classes to choose from, each preceded by its size (see Rules):
+// first four from Fig. 1.6 in [1], for FHP6
+#define PAIR_HEAD_ON /* i) "linear" */ \
+    3, E+W, NE+SW, NW+SE
+#define SYMMETRIC_3 /* ii) "triple" */ \
+    2, E+NW+SW, W+NE+SE
+#define TWO_PLUS_SPECTATOR /* iii) "lambda" */ \
+    2, E+SW+NE, E+SE+NW,  2, SE+E+W, SE+NE+SW,  2, SW+E+W, SW+NW+SE, \
+    2, W+NW+SE, W+NE+SW,  2, NW+E+W, NW+NE+SW,  2, NE+E+W, NE+NW+SE
+#define FOUR_PARTICLES /* iv) "dual-linear" */ \
+    3, NE+NW+SE+SW, E+W+SE+NW, E+W+NE+SW
+// next ones from Fig. 1.9 in [1], for FHP7
+#define PAIR_HEAD_ON_PLUS_REST /* ii) and iii) "triple" and "linear+rest" */ \
+    5, E+W+REST, NE+SW+REST, NW+SE+REST, E+NW+SW, W+NE+SE
+#define PAIR_HEAD_ON_PLUS_REST_NO_TRIPLE /* iii) "linear+rest" (used in FHP-II) */ \
+    3, E+W+REST, NE+SW+REST, NW+SE+REST
+#define ONE_PLUS_REST /* iv) and v) "fundamental+rest" and "jay" */ \
+    2, E+REST, SE+NE,  2, NE+REST, E+NW,  2, NW+REST, W+NE, \
+    2, W+REST, NW+SW,  2, SW+REST, W+SE,  2, SE+REST, SW+E
+#define TWO_PLUS_SPECTATOR_INCLUDING_REST /* vi) and (vii) "lambda" and "jay+rest" */ \
+    3, E+SW+NE, E+SE+NW, NE+SE+REST,  3, SE+E+W, SE+NE+SW, E+SW+REST, \
+    3, SW+E+W, SW+NW+SE, W+SE+REST,   3, W+NW+SE, W+NE+SW, NW+SW+REST, \
+    3, NW+E+W, NW+NE+SW, NE+W+REST,   3, NE+E+W, NE+NW+SE, NW+E+REST
+#define FOUR_PARTICLES_INCLUDING_REST_NO_MOMENTUM /* viii) and ix) "dual-linear" and "dual-triple + rest" */ \
+    5, NE+NW+SE+SW, E+W+SE+NW, E+W+NE+SW, E+NW+SW+REST, W+NE+SE+REST
+#define SYMMETRIC_3_PLUS_REST /* "dual-triple + rest" (used in FHP-II) */ \
+    2, E+NW+SW+REST, W+NE+SE+REST
+#define FOUR_PARTICLES_PLUS_REST /* x) "dual-linear + rest" */ \
+    3, NE+NW+SE+SW+REST, E+W+SE+NW+REST, E+W+NE+SW+REST
+#define FIVE_PARTICLES_INCLUDING_REST_MOMENTUM_ONE /* xi) and xii) "dual-fundamental" and "dual-jay + rest" */ \
+    2, NE+NW+W+SW+SE, E+W+NW+SW+REST,  2, E+NE+NW+W+SW, NW+SE+NE+W+REST, \
+    2, SE+E+NE+NW+W, SW+NE+E+NW+REST,  2, SW+SE+E+NE+NW, W+E+NE+SE+REST, \
+    2, W+SW+SE+E+NE, NW+SE+E+SW+REST,  2, NW+W+SW+SE+E, NE+SW+W+SE+REST
+#define TWO_PLUS_SPECTATOR_PLUS_REST /* xiii) and xiv) "dual-lambda + rest" and "dual-jay" */ \
+    3, E+SW+NE+REST, E+SE+NW+REST, NE+SE+E+W,  3, SE+E+W+REST, SE+NE+SW+REST, E+SW+SE+NW, \
+    3, SW+E+W+REST, SW+NW+SE+REST, W+SE+SW+NE, 3, W+NW+SE+REST, W+NE+SW+REST, NW+SW+W+E, \
+    3, NW+E+W+REST, NW+NE+SW+REST, NE+W+NW+SE, 3, NE+E+W+REST, NE+NW+SE+REST, NW+E+NE+SW
+
+// now select which of these collision classes each variant uses:
+template<> struct FHPLatticeGas::Rules<FHPLatticeGas::FHP_I> // (5 of the 64 states, in 2 classes)
+{
+    static const int N_STATES = 64; // no rest particle
+    static const bool SATURATED = false;
+    static constexpr state CLASSES[] = { PAIR_HEAD_ON, SYMMETRIC_3, 0 };
+};
+template<> struct FHPLatticeGas::Rules<FHPLatticeGas::FHP_II> // (22 of 128, in 10 classes)
+{
+    static const int N_STATES = 128; // including a rest particle
+    static const bool SATURATED = false;
+    static constexpr state CLASSES[] = { PAIR_HEAD_ON, SYMMETRIC_3, PAIR_HEAD_ON_PLUS_REST_NO_TRIPLE, 
+        SYMMETRIC_3_PLUS_REST, ONE_PLUS_REST, 0 };
+};
+template<> struct FHPLatticeGas::Rules<FHPLatticeGas::FHP_III> // FHP7 (76 of 128, in 28 classes)
+{
+    static const int N_STATES = 128;
+    static const bool SATURATED = true;
+    static constexpr state CLASSES[] = { PAIR_HEAD_ON, PAIR_HEAD_ON_PLUS_REST, ONE_PLUS_REST, 
+        TWO_PLUS_SPECTATOR_INCLUDING_REST, FOUR_PARTICLES_INCLUDING_REST_NO_MOMENTUM, FOUR_PARTICLES_PLUS_REST, 
+        FIVE_PARTICLES_INCLUDING_REST_MOMENTUM_ONE, TWO_PLUS_SPECTATOR_PLUS_REST, 0 };
+};
+template<> struct FHPLatticeGas::Rules<FHPLatticeGas::FHP_6> // FHP6 (20 of 64, in 9 classes)
+{
+    static const int N_STATES = 64;
+    static const bool SATURATED = true;
+    static constexpr state CLASSES[] = { PAIR_HEAD_ON, SYMMETRIC_3, TWO_PLUS_SPECTATOR, FOUR_PARTICLES, 0 };
+};
+constexpr BaseLatticeGas::state FHPLatticeGas::Rules<FHPLatticeGas::FHP_I>::CLASSES[];
+constexpr BaseLatticeGas::state FHPLatticeGas::Rules<FHPLatticeGas::FHP_II>::CLASSES[];
+constexpr BaseLatticeGas::state FHPLatticeGas::Rules<FHPLatticeGas::FHP_III>::CLASSES[];
+constexpr BaseLatticeGas::state FHPLatticeGas::Rules<FHPLatticeGas::FHP_6>::CLASSES[];
+
+#undef PAIR_HEAD_ON
+#undef SYMMETRIC_3
+#undef TWO_PLUS_SPECTATOR
+#undef FOUR_PARTICLES
+#undef PAIR_HEAD_ON_PLUS_REST
+#undef PAIR_HEAD_ON_PLUS_REST_NO_TRIPLE
+#undef ONE_PLUS_REST
+#undef TWO_PLUS_SPECTATOR_INCLUDING_REST
+#undef FOUR_PARTICLES_INCLUDING_REST_NO_MOMENTUM
+#undef SYMMETRIC_3_PLUS_REST
+#undef FOUR_PARTICLES_PLUS_REST
+#undef FIVE_PARTICLES_INCLUDING_REST_MOMENTUM_ONE
+#undef TWO_PLUS_SPECTATOR_PLUS_REST
+
+constexpr int FHPLatticeGas::GetMass(state s)
+{
+    int mass = (s & REST) ? 1 : 0;
+    for(int dir=0;dir<N_DIRS;dir++)
+        if(s & (1<<dir))
+            mass++;
+    return mass;
 }
 
-FHPLatticeGas::FHPLatticeGas(FHP_type type) : fhp_type(type)
+constexpr int FHPLatticeGas::GetMomentum(state s,int axis)
 {
-    this->BOUNDARY = 128;
-    
-    // We're following:
-    // [1] Wylie, 1990:       http://pages.cs.wisc.edu/~wylie/doc/PhD_thesis.pdf
-    // [2] Arai et al., 2007: http://www.fz-juelich.de/nic-series/volume38/arai.pdf
-    // (see also: [3] Wolf-Gladrow, 2000: http://epic.awi.de/Publications/Wol2000c.pdf)
-
-    // N.B. Interestingly, [2] and [3] seem to miss out several FHP collisions,
-    //  e.g. [2] has REST+NE+SE+W and NW+NE+SW+SE in different classes, likewise E+W+REST and NE+SE+W
-    //  (also in [2] the last transition in Fig. 6 is misprinted (mass conservation error) and again in 
-    //   Procedure 3 in Fig. 7)
-    //  e.g. [3] misses NE+SE+W <-> E+W+REST
-
-    // A "collision class" [2] is a set of states that can be swapped at will, without
-    // affecting the mass or momentum of that node. For best results, a gas should be
-    // "collision-saturated" - it swaps everything that can be swapped.
-
-    // these are some possible collision classes to choose from:
-    typedef vector<state> TStates;
-    // first four from Fig. 1.6 in [1], for FHP6
-    TStates pair_head_on = Vec(3, E+W, NE+SW, NW+SE); // i) "linear"
-    TStates symmetric_3 = Vec(2, E+NW+SW, W+NE+SE); // ii) "triple"
-    TStates two_plus_spectator[6] = { // iii) "lambda"
-        Vec(2, E+SW+NE, E+SE+NW), Vec(2, SE+E+W, SE+NE+SW), Vec(2, SW+E+W, SW+NW+SE),
-        Vec(2, W+NW+SE, W+NE+SW), Vec(2, NW+E+W, NW+NE+SW), Vec(2, NE+E+W, NE+NW+SE) };
-    TStates four_particles = Vec(3, NE+NW+SE+SW, E+W+SE+NW, E+W+NE+SW); // iv) "dual-linear"
-    // next ones from Fig. 1.9 in [1], for FHP7
-    TStates pair_head_on_plus_rest = // ii) and iii) "triple" and "linear+rest"
-        Vec(5, E+W+REST, NE+SW+REST, NW+SE+REST, E+NW+SW, W+NE+SE);
-    TStates pair_head_on_plus_rest_no_triple = // iii) "linear+rest" (used in FHP-II)
-        Vec(3, E+W+REST, NE+SW+REST, NW+SE+REST);
-    TStates one_plus_rest[6] = { // iv) and v) "fundamental+rest" and "jay"
-        Vec(2, E+REST, SE+NE), Vec(2, NE+REST, E+NW), Vec(2, NW+REST, W+NE),
-        Vec(2, W+REST, NW+SW), Vec(2, SW+REST, W+SE), Vec(2, SE+REST, SW+E) };
-    TStates two_plus_spectator_including_rest[6] = { // vi) and (vii) "lambda" and "jay+rest"
-        Vec(3, E+SW+NE, E+SE+NW, NE+SE+REST), Vec(3, SE+E+W, SE+NE+SW, E+SW+REST), 
-        Vec(3, SW+E+W, SW+NW+SE, W+SE+REST),  Vec(3, W+NW+SE, W+NE+SW, NW+SW+REST), 
-        Vec(3, NW+E+W, NW+NE+SW, NE+W+REST),  Vec(3, NE+E+W, NE+NW+SE, NW+E+REST) };
-    TStates four_particles_including_rest_no_momentum = // viii) and ix) "dual-linear" and "dual-triple + rest"
-        Vec(5, NE+NW+SE+SW, E+W+SE+NW, E+W+NE+SW, E+NW+SW+REST, W+NE+SE+REST );
-    TStates symmetric_3_plus_rest = Vec(2, E+NW+SW+REST, W+NE+SE+REST); // "dual-triple + rest" (used in FHP-II)
-    TStates four_particles_plus_rest = Vec(3, NE+NW+SE+SW+REST, E+W+SE+NW+REST, E+W+NE+SW+REST); // x) "dual-linear + rest"
-    TStates five_particles_including_rest_momentum_one[6] = { // xi) and xii) "dual-fundamental" and "dual-jay + rest"
-        Vec(2, NE+NW+W+SW+SE, E+W+NW+SW+REST), Vec(2, E+NE+NW+W+SW, NW+SE+NE+W+REST),
-        Vec(2, SE+E+NE+NW+W, SW+NE+E+NW+REST), Vec(2, SW+SE+E+NE+NW, W+E+NE+SE+REST),
-        Vec(2, W+SW+SE+E+NE, NW+SE+E+SW+REST), Vec(2, NW+W+SW+SE+E, NE+SW+W+SE+REST) };
-    TStates two_plus_spectator_plus_rest[6] = { // xiii) and xiv) "dual-lambda + rest" and "dual-jay"
-        Vec(3, E+SW+NE+REST, E+SE+NW+REST, NE+SE+E+W), Vec(3, SE+E+W+REST, SE+NE+SW+REST, E+SW+SE+NW), 
-        Vec(3, SW+E+W+REST, SW+NW+SE+REST, W+SE+SW+NE),  Vec(3, W+NW+SE+REST, W+NE+SW+REST, NW+SW+W+E), 
-        Vec(3, NW+E+W+REST, NW+NE+SW+REST, NE+W+NW+SE),  Vec(3, NE+E+W+REST, NE+NW+SE+REST, NW+E+NE+SW) };
-    // now select which of these collision classes we're going to use:
-    switch(type)
-    {
-        case FHP_I:
-            this->collision_classes.push_back(pair_head_on);
-            this->collision_classes.push_back(symmetric_3);
-            break;
-        case FHP_II:
-            this->collision_classes.push_back(pair_head_on);
-            this->collision_classes.push_back(symmetric_3);
-            this->collision_classes.push_back(pair_head_on_plus_rest_no_triple);
-            this->collision_classes.push_back(symmetric_3_plus_rest);
-            for(int i=0;i<6;i++)
-                this->collision_classes.push_back(one_plus_rest[i]);
-            break;
-        case FHP_III: // FHP7, collision-saturated
-            this->collision_classes.push_back(pair_head_on);
-            this->collision_classes.push_back(pair_head_on_plus_rest);
-            for(int i=0;i<6;i++)
-            {
-                this->collision_classes.push_back(one_plus_rest[i]);
-                this->collision_classes.push_back(two_plus_spectator_including_rest[i]);
-            }
-            this->collision_classes.push_back(four_particles_including_rest_no_momentum);
-            this->collision_classes.push_back(four_particles_plus_rest);
-            for(int i=0;i<6;i++)
-            {
-                this->collision_classes.push_back(five_particles_including_rest_momentum_one[i]);
-                this->collision_classes.push_back(two_plus_spectator_plus_rest[i]);
-            }
-            break;
-        case FHP_6: // FHP6, collision-saturated
-            this->collision_classes.push_back(pair_head_on);
-            this->collision_classes.push_back(symmetric_3);
-            for(int i=0;i<6;i++) 
-            {
-                this->collision_classes.push_back(two_plus_spectator[i]);
-            }
-            this->collision_classes.push_back(four_particles);
-            break;
-    }
-    // optional debug checks:
-    if(true)
+    // (in units that keep it whole: each direction of DIR, scaled by 2 in x and 2/sqrt(3) in y)
+    const int units[N_DIRS][2] = { {2,0}, {1,1}, {-1,1}, {-2,0}, {-1,-1}, {1,-1} };
+    int p = 0;
+    for(int dir=0;dir<N_DIRS;dir++)
+        if(s & (1<<dir))
+            p += units[dir][axis];
+    return p;
+}
+
+constexpr bool FHPLatticeGas::IsEquivalent(state s1,state s2)
+{
+    return GetMass(s1)==GetMass(s2) && GetMomentum(s1,0)==GetMomentum(s2,0) && GetMomentum(s1,1)==GetMomentum(s2,1);
+}
+
+constexpr bool FHPLatticeGas::IsConserving(const state *classes,int n_states)
+{
+    bool seen[128] = {};
+    for(const state *c=classes;*c;c+=1+*c)
     {
+        for(int i=1;i<=*c;i++)
         {
-            int n_cases_swapped = 0;
-            for(vector<TStates>::iterator it=this->collision_classes.begin();it!=this->collision_classes.end();it++)
-                n_cases_swapped += it->size();
-            // should be: 
-            // FHP-I: 5 of 64 (in 2 classes)
-            // FHP6: 20 of 64 (in 9 classes)
-            // FHP-II: 22 of 128 (in 10 classes)
-            // FHP-III: 76 of 128 (in 28 classes)
+            if(c[i]>=n_states || seen[c[i]]) 
+                return false; // out of range, or in more than one class
+            seen[c[i]] = true;
+            if(!IsEquivalent(c[1],c[i]))
+                return false; // the collision would change the mass or momentum
         }
-        try 
-        {
-            // check that all these collision cases maintain momentum and mass
-            VerifyCollisionMap();
-            // check that these collision cases are complete: any other swaps possible?
-            if(this->fhp_type==FHP_III || this->fhp_type==FHP_6) // (only these expected to be complete)
-                VerifyIsCollisionSaturated();
-        }
-        catch(runtime_error e)
+    }
+    return true;
+}
+
+constexpr bool FHPLatticeGas::IsSaturated(const state *classes,int n_states)
+{
+    // any two states with the same mass and momentum must be in the same class
+    int class_of[128] = {};
+    for(int s=0;s<n_states;s++)
+        class_of[s] = -1;
+    int i_class = 0;
+    for(const state *c=classes;*c;c+=1+*c,i_class++)
+        for(int i=1;i<=*c;i++)
+            class_of[c[i]] = i_class;
+    for(int s1=0;s1<n_states;s1++)
+        for(int s2=s1+1;s2<n_states;s2++)
+            if(IsEquivalent(s1,s2) && (class_of[s1]<0 || class_of[s1]!=class_of[s2]))
+                return false;
+    return true;
+}
+
+constexpr FHPLatticeGas::CollisionMaps FHPLatticeGas::MakeCollisionMaps(const state *classes)
+{
+    CollisionMaps maps = {};
+    for(int choice=0;choice<N_COLLISION_CHOICES;choice++)
+    {
+        for(int s=0;s<=128;s++)
+            maps.m[choice][s] = s; // default: no change
+        for(const state *c=classes;*c;c+=1+*c)
         {
-            wxASSERT_MSG(false,e.what());
-            throw e;
+            const int n = *c;
+            const int move = 1 + choice%(n-1); // each i will become i+move mod n
+            for(int i=0;i<n;i++)
+                maps.m[choice][c[1+i]] = c[1+(i+move)%n];
         }
     }
-    InitializeCollisionMap();
+    return maps;
+}
+
+// the checks that the rules have been typed in correctly are made here, when they are compiled
+template<FHPLatticeGas::FHP_type TYPE> struct FHPLatticeGas::CheckedRules
+{
+    static_assert(IsConserving(Rules<TYPE>::CLASSES,Rules<TYPE>::N_STATES),
+        "FHP collision classes: a state is out of range, is listed twice, or doesn't keep its mass and momentum");
+    static_assert(!Rules<TYPE>::SATURATED || IsSaturated(Rules<TYPE>::CLASSES,Rules<TYPE>::N_STATES),
+        "FHP collision classes: a collision-saturated gas is missing a case");
+    static constexpr CollisionMaps MAPS = MakeCollisionMaps(Rules<TYPE>::CLASSES);
+};
+template<FHPLatticeGas::FHP_type TYPE> constexpr FHPLatticeGas::CollisionMaps FHPLatticeGas::CheckedRules<TYPE>::MAPS;
+
+FHPLatticeGas::FHPLatticeGas(FHP_type type) : fhp_type(type)
+{
+    this->BOUNDARY = 128;
+
+    switch(type)
+    {
+        case FHP_I: SetRules<FHP_I>(); break;
+        case FHP_II: SetRules<FHP_II>(); break;
+        case FHP_III: SetRules<FHP_III>(); break;
+        case FHP_6: SetRules<FHP_6>(); break;
+        case FHP_Custom: SetRules(GasRules()); break; // (no collisions, until some rules are given)
+    }
 
     // create the flow_samples array
     //state samples[] = { NE, SE, E, NE, SE, E, NE, SE, E, NE, SE, E, NW, SW, W }; 
@@ -169,111 +234,198 @@ FHPLatticeGas::FHPLatticeGas(FHP_type type) : fhp_type(type)
     this->backward_flow_samples.assign(backward_samples,backward_samples+sizeof(backward_samples)/sizeof(state));
 }
 
+FHPLatticeGas::FHPLatticeGas(const GasRules& rules) : FHPLatticeGas(FHP_Custom)
+{
+    if(rules.GetLattice()!=GasRules::Lattice_Hex)
+        throw runtime_error("FHPLatticeGas : these rules aren't for a hex lattice");
+    SetRules(rules);
+}
+
+vector<unsigned int> FHPLatticeGas::GetCollisionFlipTable() const
+{
+    // (only the states in a collision class collide)
+    vector<unsigned int> flips(128*N_COLLISION_CHOICES,0);
+    for(int iClass=0;iClass<(int)this->collision_classes.size();iClass++)
+    {
+        for(int iCollision=0;iCollision<(int)this->collision_classes[iClass].size();iCollision++)
+        {
+            const state s = this->collision_classes[iClass][iCollision];
+            for(int choice=0;choice<N_COLLISION_CHOICES;choice++)
+                flips[choice*128+s] = s ^ this->collision_maps[choice][s];
+        }
+    }
+    return flips;
+}
+
 void FHPLatticeGas::InsertRandomFlow(int x,int y)
 {
-    this->grid[current_buffer][x][y] = this->forward_flow_samples[rand()%this->forward_flow_samples.size()];
+    this->grid[current_buffer].At(x,y) = this->forward_flow_samples[GetRandom(Random_Initialization,x,y)%this->forward_flow_samples.size()];
 }
 
 void FHPLatticeGas::InsertRandomBackwardFlow(int x,int y)
 {
-    this->grid[current_buffer][x][y] = this->backward_flow_samples[rand()%this->backward_flow_samples.size()];
+    this->grid[current_buffer].At(x,y) = this->backward_flow_samples[GetRandom(Random_Initialization,x,y)%this->backward_flow_samples.size()];
 }
 
 void FHPLatticeGas::InsertRandomParticle(int x,int y)
 {
-    this->grid[current_buffer][x][y] = ((rand()%50)==0)?(1<<(rand()%N_DIRS)):0;
+    const unsigned int r = GetRandom(Random_Initialization,x,y);
+    this->grid[current_buffer].At(x,y) = ((r%50)==0)?(1<<((r/50)%N_DIRS)):0;
 }
 
 void FHPLatticeGas::UpdateGas()
 {
-    this->RandomizeCollisionMap(); 
-
-    current_buffer = old_buffer;
-    old_buffer = 1-current_buffer;
-
-    const vector<vector<state> > &OldBuffer = this->grid[old_buffer];
-    vector<vector<state> > &NewBuffer = this->grid[current_buffer];
-
-    //const vector<vector<vector<state*> > > & oldbuf_nbors_lut = this->nbors_lut[old_buffer];
+    UpdateAllRows();
+}
 
-    int from_x = force_flow?1:0;
+void FHPLatticeGas::UpdateRows(const StateGrid &in,StateGrid &out,int from_y,int to_y,int iteration)
+{
+    if(this->n_states>64)
+        UpdateRowsOf<128>(in,out,from_y,to_y,iteration);
+    else
+        UpdateRowsOf<64>(in,out,from_y,to_y,iteration);
+}
 
-    /*const state* p1= &OldBuffer[1][0];
-    const state* p2 = &OldBuffer[2][0];
-    const int pDiff = &OldBuffer[2][0] - &OldBuffer[1][0];
-    const state* p3 = p1+pDiff;
-    wxASSERT(p3==p2);*/
+template<int N_STATES>
+void FHPLatticeGas::UpdateRowsOf(const StateGrid &in,StateGrid &out,int from_y,int to_y,int iteration)
+{
+    const int n_words = (X+31)/32; // (for the collision choices)
 
-    //#pragma omp parallel for
-    for(int y=0;y<Y;y++)
+    #pragma omp parallel
     {
-        //const state* nbors_lut[N_DIRS];
-        const vector<vector<int> > &nbors = NBORS[y%2]; // alternate rows are indented (see HexGridLatticeGas)
-        state new_state,nbor;
-        int dir,oppositedir;
-        for(int x=from_x;x<X;x++)
+        vector<unsigned int> choice_bits(2*n_words+1);
+
+        // (each row draws its own random numbers, so the result doesn't depend on how the rows are shared out)
+        #pragma omp for
+        for(int y=from_y;y<to_y;y++)
         {
-            /*if(x<=1 || x==X-1)
+            state *new_row = out.Row(y);
+            bool have_choices = false;
+            int link = this->first_boundary_link[y];
+            const int end_link = this->first_boundary_link[y+1];
+            for(int x=0;x<X;)
             {
-                // initialise nbors_lut
-                for(dir=0;dir<N_DIRS;dir++)
-                    nbors_lut[dir] = &(OldBuffer[(x+nbors[opposite_dir(dir)][0]+X)%X][(y+nbors[opposite_dir(dir)][1]+Y)%Y]);
-            }
-            else
-            {
-                // increment nbors_lut (faster)
-                for(dir=0;dir<N_DIRS;dir++)
+                // the tiles that can't change on this step are just copied over (see GetNextRun)
+                bool active;
+                const int end_x = GetNextRun(y,x,iteration,active);
+                if(!active)
                 {
-                    nbors_lut[dir]+=pDiff; // pointer increment
-                    p1 = &(OldBuffer[(x+nbors[opposite_dir(dir)][0]+X)%X][(y+nbors[opposite_dir(dir)][1]+Y)%Y]);
-                    wxASSERT(nbors_lut[dir] == p1);
-                    int d=1;
+                    copy(in.Row(y)+x,in.Row(y)+end_x,new_row+x);
+                    while(link<end_link && this->boundary_links[link].x<end_x)
+                        link++;
+                    x = end_x;
+                    continue;
                 }
-            }*/
-            const state& c = OldBuffer[x][y];
-            if(c==BOUNDARY) continue;
-            new_state = c & REST;
-            for(dir=0,oppositedir=N_DIRS/2;dir<N_DIRS;dir++,oppositedir=(oppositedir+1)%N_DIRS) 
-                // (this is the innermost loop: optimize here!)
-            {
-                nbor = OldBuffer[(x+nbors[oppositedir][0]+X)%X][(y+nbors[oppositedir][1]+Y)%Y];
-                //nbor = *oldbuf_nbors_lut[dir][x][y];
-                //nbor = *(nbors_lut[dir]);
-                //nbor = OldBuffer[(x+nbors[opposite_dir(dir)][0]+X)%X][(y+nbors[opposite_dir(dir)][1]+Y)%Y];
-                if(nbor!=BOUNDARY)
+                if(!have_choices)
                 {
-                    // accept an inbound particle travelling in this direction, if there is one
-                    new_state |= nbor&(1<<dir);
+                    GetCollisionChoices(y,iteration,n_words,&choice_bits[0]);
+                    have_choices = true;
                 }
-                else if(c&(1<<oppositedir))
+                // move the particles as if there were no obstacles, then redo the cells where particles
+                // bounce back off one, and put the obstacles back (see FindBoundaryLinksIfNeeded)
+                const int from_x = x;
+#ifdef HAVE_BYTE_VECTOR
+                // do as much of the run as we can many cells at a time, and the rest one by one
+                const int to_x = x+((end_x-x)/ByteVector::WIDTH)*ByteVector::WIDTH;
+                UpdateCellsVectorized<N_STATES>(in,out,y,x,to_x,&choice_bits[0],n_words);
+                x = to_x;
+#endif
+                for(;x<end_x;x++)
+                    new_row[x] = GetNewState<N_STATES>(in,x,y,0,GetCollisionChoice(&choice_bits[0],n_words,x));
+                for(;link<end_link && this->boundary_links[link].x<end_x;link++)
                 {
-                    // or if the neighbor is a boundary then reverse one of our own particles
-                    new_state |= 1<<dir;
+                    const BoundaryLink &l = this->boundary_links[link];
+                    new_row[l.x] = GetNewState<N_STATES>(in,l.x,y,l.links,GetCollisionChoice(&choice_bits[0],n_words,l.x));
                 }
+                RestoreObstacles(new_row,y,from_x,end_x);
+            }
+
+            if(force_flow)
+            {
+                // the left-most column gets overwritten randomly, since we are simulating
+                // an infinite tube filled with moving gas
+                state s = in.At(0,y);
+                if(s!=BOUNDARY)
+                    s = GetInflowSample(y,iteration);
+                new_row[0] = s;
             }
-            // apply the collisions remapping, and store the new value
-            NewBuffer[x][y] = this->collision_map[new_state];
+            ClassifyRow(new_row,y,iteration+1);
         }
     }
+}
 
-    if(force_flow)
+template<int N_STATES>
+BaseLatticeGas::state FHPLatticeGas::GetNewState(const StateGrid &in,int x,int y,state links,int choice) const
+{
+    const vector<vector<int> > &nbors = NBORS[y%2]; // alternate rows are indented (see HexGridLatticeGas)
+    const state c = in.At(x,y);
+    state new_state = (N_STATES>64) ? (c & REST) : 0; // (a rest particle stays put)
+    for(int dir=0;dir<N_DIRS;dir++) 
     {
-        state s;
-        for(int y=0;y<Y;y++)
+        // accept an inbound particle travelling in this direction, if there is one (an obstacle has 
+        // none), or if the neighbor is an obstacle then reverse one of our own particles
+        const int od = opposite_dir(dir);
+        new_state |= in.At(x+nbors[od][0],y+nbors[od][1]) & (1<<dir); // (may be in the halo)
+        if(c & links & (1<<od))
+            new_state |= 1<<dir;
+    }
+    // apply the collisions remapping
+    return this->collision_maps[choice][new_state];
+}
+
+BaseLatticeGas::state FHPLatticeGas::GetBoundaryLinks(int x,int y) const
+{
+    if(IsObstacle(x,y)) return 0;
+    const vector<vector<int> > &nbors = NBORS[y%2];
+    state links = 0;
+    for(int dir=0;dir<N_DIRS;dir++)
+        if(IsObstacle(x+nbors[dir][0],y+nbors[dir][1]))
+            links |= 1<<dir;
+    return links;
+}
+
+#ifdef HAVE_BYTE_VECTOR
+template<int N_STATES>
+void FHPLatticeGas::UpdateCellsVectorized(const StateGrid &in,StateGrid &out,int y,int from_x,int to_x,
+    const unsigned int *choice_bits,int n_words) const
+{
+    typedef ByteVector V;
+    typedef ByteVector::type vec;
+
+    const vector<vector<int> > &nbors = NBORS[y%2]; // alternate rows are indented (see HexGridLatticeGas)
+    const state *row = in.Row(y);
+    state *new_row = out.Row(y);
+
+    // for each direction, where does an inbound particle come from?
+    const state *src[N_DIRS];
+    for(int dir=0;dir<N_DIRS;dir++)
+    {
+        const int od = opposite_dir(dir);
+        src[dir] = in.Row(y+nbors[od][1]) + nbors[od][0]; // (may be in the halo)
+    }
+
+    V::Table128 tables[N_COLLISION_CHOICES];
+    for(int i=0;i<N_COLLISION_CHOICES;i++)
+        V::LoadTable128(this->collision_maps[i],tables[i]); // (only the first 128 entries are needed)
+    const vec rest = V::Set1((N_STATES>64) ? REST : 0); // (a rest particle stays put)
+
+    for(int x=from_x;x<to_x;x+=V::WIDTH)
+    {
+        const vec c = V::Load(row+x);
+        vec new_state = V::And(c,rest);
+        for(int dir=0;dir<N_DIRS;dir++)
         {
-            // the left-most column gets overwritten randomly, since we are simulating
-            // an infinite tube filled with moving gas
-            s = OldBuffer[0][y];
-            if(s==BOUNDARY) continue;
-            s = this->forward_flow_samples[rand()%this->forward_flow_samples.size()];
-            NewBuffer[0][y]=s;
+            // accept an inbound particle travelling in this direction (an obstacle has none)
+            new_state = V::Or(new_state,V::And(V::Load(src[dir]+x),V::Set1(1<<dir)));
         }
+        // apply the collisions remapping, with each cell's own choice
+        const int w = x>>5, shift = x&31; // (the next 64 choices, see GetCollisionChoices)
+        const vec choice_low = V::MaskFromBits((((uint64_t)choice_bits[w+1]<<32) | choice_bits[w])>>shift);
+        const vec choice_high = V::MaskFromBits((((uint64_t)choice_bits[n_words+w+1]<<32) | choice_bits[n_words+w])>>shift);
+        V::Store(new_row+x,V::LookupX4<N_STATES>(tables,new_state,choice_low,choice_high));
     }
-
-    this->iterations++;
-    this->need_recompute_flow = true;
-    this->need_redraw_images = true;
 }
+#endif
 
 RealPoint FHPLatticeGas::GetAverageInputFlowVelocityPerParticle() const
 {
@@ -318,9 +470,8 @@ float FHPLatticeGas::GetAverageInputNumParticlesPerCell() const
     return n_particles_counted / (float)this->forward_flow_samples.size();
 }
 
-int FHPLatticeGas::GetNumGasParticlesAt(int x, int y) const
+int FHPLatticeGas::GetNumGasParticlesInState(state s) const
 {
-    state s = this->grid[current_buffer][x][y];
     int n_gas_particles = 0;
     for(int i=0;i<7;i++)
         if(s & (1<<i))
@@ -328,34 +479,27 @@ int FHPLatticeGas::GetNumGasParticlesAt(int x, int y) const
     return n_gas_particles;
 }
 
-int FHPLatticeGas::GetMaxNumGasParticlesAt(int x, int y) const
+int FHPLatticeGas::GetMaxNumGasParticlesInState(state s) const
 {
-    state s = this->grid[current_buffer][x][y];
     if(s==BOUNDARY) return 0;
     else {
-        if(this->fhp_type==FHP_II || this->fhp_type==FHP_III)
+        if(this->n_states>64)
             return 7; // (these gases include a rest particle)
         else
             return 6;
     }
 }
 
-RealPoint FHPLatticeGas::GetVelocityAt(int x, int y) const
+Colour FHPLatticeGas::GetColourOfState(state s,int /*x*/,int /*y*/,bool show_velocity) const
 {
-    return GetVelocity(grid[current_buffer][x][y]);
-}
-
-wxColour FHPLatticeGas::GetColour(int x, int y) const
-{
-    state s = this->grid[current_buffer][x][y];
-    wxColour c;
-    if(s==0) c=wxColour(0,0,0);
-    else if(s==BOUNDARY) c=wxColour(120,120,120);
+    Colour c;
+    if(s==0) c=Colour(0,0,0);
+    else if(s==BOUNDARY) c=Colour(120,120,120);
     else {
-        if(this->show_gas_colours)
+        if(show_velocity)
         {
             if(s==REST) 
-                c=wxColour(200,200,200);
+                c=Colour(200,200,200);
             else{
                 RealPoint v = GetVelocity(s);
                 c = GetVectorAngleColour(v.x,v.y);
@@ -363,227 +507,44 @@ wxColour FHPLatticeGas::GetColour(int x, int y) const
         }
         else
         {
-            float density = GetNumGasParticlesAt(x,y) / (float)GetMaxNumGasParticlesAt(x,y);
+            float density = GetNumGasParticlesInState(s) / (float)GetMaxNumGasParticlesInState(s);
             c = GetDensityColour(density);
         }
     }
     return c;
 }
 
-void FHPLatticeGas::InitializeCollisionMap()
+template<FHPLatticeGas::FHP_type TYPE>
+void FHPLatticeGas::SetRules()
 {
-    for(state s=0;s<=BOUNDARY;s++)
-        this->collision_map[s] = s; // default: no change
-    for(int iClass=0;iClass<(int)this->collision_classes.size();iClass++)
-    {
-        for(int iCollision=0;iCollision<(int)this->collision_classes[iClass].size();iCollision++)
-        {
-            int input = this->collision_classes[iClass][iCollision];
-            int output = this->collision_classes[iClass][(iCollision+1)%this->collision_classes[iClass].size()];
-            // (each collision state becomes the next one in its class)
-            this->collision_map[input] = output;
-        }
-    }
+    this->collision_classes.clear();
+    for(const state *c=Rules<TYPE>::CLASSES;*c;c+=1+*c)
+        this->collision_classes.push_back(vector<state>(c+1,c+1+*c));
+    const CollisionMaps &maps = CheckedRules<TYPE>::MAPS;
+    for(int choice=0;choice<N_COLLISION_CHOICES;choice++)
+        copy(maps.m[choice],maps.m[choice]+129,this->collision_maps[choice]);
+    this->n_states = Rules<TYPE>::N_STATES;
 }
 
-void FHPLatticeGas::RandomizeCollisionMap()
+void FHPLatticeGas::SetRules(const GasRules& rules)
 {
-    for(int iClass=0;iClass<(int)this->collision_classes.size();iClass++)
-    {
-        int nCollisions = this->collision_classes[iClass].size();
-        if(nCollisions>2) // no need to randomize outcome of collision classes with just two entries
-        {
-            int move = 1 + (rand()%(nCollisions-1)); // each i will become i+move mod n
-            for(int iCollision=0;iCollision<nCollisions;iCollision++)
-            {
-                int input = this->collision_classes[iClass][iCollision];
-                int output = this->collision_classes[iClass][(iCollision+move)%nCollisions];
-                this->collision_map[input] = output;
-            }
-        }
-    }
+    // (GasRules uses the same bits and the same way of picking an outcome, and has checked the rules)
+    static_assert(GasRules::N_COLLISION_CHOICES==N_COLLISION_CHOICES,"GasRules: a different number of collision choices");
+    this->collision_classes = rules.GetCollisionClasses();
+    for(int choice=0;choice<N_COLLISION_CHOICES;choice++)
+        for(int s=0;s<=128;s++)
+            this->collision_maps[choice][s] = rules.GetCollision(choice,s);
+    this->n_states = rules.GetNumStates();
 }
 
-// each transition must maintain mass and momentum
-void FHPLatticeGas::VerifyCollisionMap()
+void FHPLatticeGas::GetCollisionChoices(int y,int iteration,int n_words,unsigned int *bits) const
 {
-    state max_state;
-    switch(this->fhp_type)
-    {
-        case FHP_II: 
-        case FHP_III: 
-            max_state=128; // including a rest particle
-            break;
-        case FHP_I:
-        case FHP_6: 
-            max_state=64; // no rest particle
-            break;
-    }
-    vector<bool> checked(max_state,false);
-    for(int iClass=0;iClass<(int)this->collision_classes.size();iClass++)
-    {
-        state s1 = this->collision_classes[iClass][0];
-        if(s1<0 || s1>=max_state)
-        {
-            ostringstream oss;
-            oss << "Range error: " << GetReport(s1);
-            throw runtime_error(oss.str());
-        }
-        // also verify that each state appears in the collision cases at most once
-        if(checked[s1])
-        {
-            ostringstream oss;
-            oss << "Duplication error: " << GetReport(s1);
-            throw runtime_error(oss.str());
-        }
-        checked[s1]=true;
-        for(int iCollision=1;iCollision<(int)this->collision_classes[iClass].size();iCollision++)
-        {
-            state s2 = this->collision_classes[iClass][iCollision];
-            if(s2<0 || s2>=max_state)
-            {
-                ostringstream oss;
-                oss << "Range error: " << GetReport(s2);
-                throw runtime_error(oss.str());
-            }
-            if(checked[s2])
-            {
-                ostringstream oss;
-                oss << "Duplication error: " << GetReport(s2);
-                throw runtime_error(oss.str());
-            }
-            checked[s2]=true;
-            RealPoint v1,v2;
-            int mass1,mass2;
-            // find the mass and momentum of s1 and s2
-            mass1 = (s1 & REST)?1:0;
-            mass2 = (s2 & REST)?1:0;
-            for(int dir=0;dir<N_DIRS;dir++)
-            {
-                if(s1 & (1<<dir))
-                {
-                    v1 += RealPoint(DIR[dir][0],DIR[dir][1]);
-                    mass1++;
-                }
-                if(s2 & (1<<dir))
-                {
-                    v2 += RealPoint(DIR[dir][0],DIR[dir][1]);
-                    mass2++;
-                }
-            }    
-            double d = fabs(v1.x-v2.x)+fabs(v1.y-v2.y);
-            if(mass1!=mass2)
-            {
-                ostringstream oss;
-                oss << "Mass conservation error: " << GetReport(s1) << "->" << GetReport(s2);
-                throw runtime_error(oss.str());
-            }
-            else if(d>1E-08)
-            {
-                ostringstream oss;
-                oss << "Momentum conservation error: " << GetReport(s1) << "->" << GetReport(s2);
-                throw runtime_error(oss.str());
-            }
-        }
-    }
+    GetRandomRow(Random_Collisions,0,y,2*n_words+1,bits,iteration);
 }
 
-void FHPLatticeGas::VerifyIsCollisionSaturated()
+BaseLatticeGas::state FHPLatticeGas::GetInflowSample(int y,int iteration) const
 {
-    state max_state;
-    switch(this->fhp_type)
-    {
-        default:
-        case FHP_III: max_state=128; break; // including a rest particle
-        case FHP_6: max_state=64; break; // no rest particle
-        // (no other gas types are expected to be collision-saturated)
-    }
-    // for each collision class: is there any other state that should be in that class?
-    vector<bool> checked(max_state,false);
-    for(int iClass=0;iClass<(int)this->collision_classes.size();iClass++)
-    {
-        for(int iCollision=1;iCollision<(int)this->collision_classes[iClass].size();iCollision++)
-        {
-            state s1 = this->collision_classes[iClass][0];
-            checked[s1]=true;
-            RealPoint v1;
-            int mass1;
-            // find the mass and momentum of s1
-            mass1 = (s1 & REST)?1:0;
-            for(int dir=0;dir<N_DIRS;dir++)
-            {
-                if(s1 & (1<<dir))
-                {
-                    v1 += RealPoint(DIR[dir][0],DIR[dir][1]);
-                    mass1++;
-                }
-            }    
-            // now check every state not in class, to see if it has the same mass and momentum
-            for(state s2=0;s2<max_state;s2++)
-            {
-                if(find(this->collision_classes[iClass].begin(),this->collision_classes[iClass].end(),s2)!=this->collision_classes[iClass].end())
-                {
-                    checked[s2]=true;
-                    continue; // this state already in the class
-                }
-                RealPoint v2;
-                int mass2 = (s2 & REST)?1:0;
-                for(int dir=0;dir<N_DIRS;dir++)
-                {
-                    if(s2 & (1<<dir))
-                    {
-                        v2 += RealPoint(DIR[dir][0],DIR[dir][1]);
-                        mass2++;
-                    }
-                }    
-                double d = fabs(v1.x-v2.x)+fabs(v1.y-v2.y);
-                if(mass1==mass2 && d<1E-08)
-                {
-                    ostringstream oss;
-                    oss << "Missing case: " << GetReport(s1) << "<-->" << GetReport(s2);
-                    throw runtime_error(oss.str());
-                }
-            }
-        }
-    }
-    // for every state not in a collision class: is there any other state with equal mass and momentum?
-    for(state s1=0;s1<max_state;s1++)
-    {
-        if(checked[s1]) continue;
-        // find the mass and momentum of s1
-        RealPoint v1;
-        int mass1 = (s1 & REST)?1:0;
-        for(int dir=0;dir<N_DIRS;dir++)
-        {
-            if(s1 & (1<<dir))
-            {
-                v1 += RealPoint(DIR[dir][0],DIR[dir][1]);
-                mass1++;
-            }
-        }    
-        for(state s2=0;s2<max_state;s2++)
-        {
-            if(s2==s1 || checked[s2]) continue;
-            // find the mass and momentum of s2
-            RealPoint v2;
-            int mass2 = (s2 & REST)?1:0;
-            for(int dir=0;dir<N_DIRS;dir++)
-            {
-                if(s2 & (1<<dir))
-                {
-                    v2 += RealPoint(DIR[dir][0],DIR[dir][1]);
-                    mass2++;
-                }
-            }    
-            double d = fabs(v1.x-v2.x)+fabs(v1.y-v2.y);
-            if(mass1==mass2 && d<1E-08)
-            {
-                ostringstream oss;
-                oss << "Missing case: " << GetReport(s1) << "<->" << GetReport(s2);
-                throw runtime_error(oss.str());
-            }
-        }
-    }
+    return this->forward_flow_samples[GetRandom(Random_Inflow,0,y,iteration)%this->forward_flow_samples.size()];
 }
 
 string FHPLatticeGas::GetReport(state s) const
@@ -611,7 +572,7 @@ string FHPLatticeGas::GetReport(state s) const
 
 void FHPLatticeGas::ResizeGrid(int x_size,int y_size)
 {
-    BaseLatticeGas_drawable::ResizeGrid(x_size,y_size);
+    HexGridLatticeGas::ResizeGrid(x_size,y_size);
     // resize the nbors_lut and fill with pointers
     /*for(int iBuf=0;iBuf<2;iBuf++)
     {
@@ -16,59 +16,130 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#ifndef __FHPLATTICEGAS__
+#define __FHPLATTICEGAS__
+
 #include "HexGridLatticeGas.h"
+#include "GasRules.h"
 
 class FHPLatticeGas : public HexGridLatticeGas
 {
     public:
 
-        enum FHP_type { FHP_I, FHP_II, FHP_III, FHP_6 };
+        // (FHP_Custom: rules from a file, see GasRules)
+        enum FHP_type { FHP_I, FHP_II, FHP_III, FHP_6, FHP_Custom };
 
         FHPLatticeGas(FHP_type type);
+        // a gas with rules loaded at run time (throws runtime_error if they aren't for a hex lattice)
+        FHPLatticeGas(const GasRules& rules);
 
         void UpdateGas(); // override
 
         RealPoint GetAverageInputFlowVelocityPerParticle() const; // override
         float GetAverageInputNumParticlesPerCell() const; // override
 
-    protected: // functions
+        Colour GetColourOfState(state s,int x,int y,bool show_velocity) const; // override
+
+        // the collisions as a truth table, for compiling into a circuit (see BitSlicedCircuit::Compile):
+        // from the 7 bits of a state and the 2 bits of the collision choice (bits 7 and 8 of the index)
+        // to the bits of the state that the collision changes
+        vector<unsigned int> GetCollisionFlipTable() const;
 
-        int GetNumGasParticlesAt(int x,int y) const; // override
-        int GetMaxNumGasParticlesAt(int x,int y) const; // override
+    protected: // functions
 
-        RealPoint GetVelocityAt(int x,int y) const; // override
-        wxColour GetColour(int x,int y) const; // override
         string GetReport(state s) const; // override
 
+        int GetNumGasParticlesInState(state s) const; // override
+        int GetMaxNumGasParticlesInState(state s) const; // override
+
         void InsertRandomFlow(int x,int y); // override
         void InsertRandomBackwardFlow(int x,int y); // override
         void InsertRandomParticle(int x,int y); // override
 
-        void InitializeCollisionMap();
-        void RandomizeCollisionMap();
-
-        // a helper function to assemble vectors from values
-        vector<state> Vec(int n, ...);
-
-        // an internal check that we haven't typed something in wrongly
-        void VerifyCollisionMap();
-
-        // an internal check that a gas is collision-saturated
-        void VerifyIsCollisionSaturated();
+        // the rules of each variant, fixed at compile time (see FHPLatticeGas.cpp): N_STATES is 64 without
+        // the rest particle and 128 with it, CLASSES lists the collision classes one after another,
+        // each preceded by its size, with a 0 at the end, and SATURATED says whether every possible 
+        // collision should be among them
+        template<FHP_type TYPE> struct Rules;
+
+        // the collision maps for one of the Rules, built (and the rules checked) by the compiler
+        template<FHP_type TYPE> struct CheckedRules;
+
+        // fill collision_classes and collision_maps with the rules of one variant
+        template<FHP_type TYPE> void SetRules();
+        // (or with rules loaded at run time)
+        void SetRules(const GasRules& rules);
+
+        // fills bits with the random collision choices for row y on the given iteration, as two bit-planes of 
+        // n_words each (plus one spare word): bit x of the first plane is the low bit of the choice for cell x
+        void GetCollisionChoices(int y,int iteration,int n_words,unsigned int *bits) const;
+
+        // the choice for cell x (0 to N_COLLISION_CHOICES-1), from the bit-planes filled by GetCollisionChoices
+        static int GetCollisionChoice(const unsigned int *bits,int n_words,int x)
+        {
+            return ((bits[x>>5]>>(x&31))&1) | (((bits[n_words+(x>>5)]>>(x&31))&1)<<1);
+        }
+
+        // a state for the inlet at row y on the given iteration
+        state GetInflowSample(int y,int iteration) const;
+
+        bool CanUpdateRows() const { return true; } // override
+        void UpdateRows(const StateGrid &in,StateGrid &out,int from_y,int to_y,int iteration); // override
+
+        // the same, for N_STATES of 64 (no rest particle) or 128 (UpdateRows picks one by n_states): the 
+        // collisions are looked up in collision_maps, so this serves every variant
+        template<int N_STATES> void UpdateRowsOf(const StateGrid &in,StateGrid &out,int from_y,int to_y,int iteration);
+
+        // the state of cell x,y on the next step: propagation from in (whose halo must be up to date), 
+        // then collision using collision_maps[choice] - bit d of links is set if the neighbor in direction 
+        // d is an obstacle (cell x,y mustn't be an obstacle itself)
+        template<int N_STATES> state GetNewState(const StateGrid &in,int x,int y,state links,int choice) const;
+
+        // the same for cells from_x to to_x-1 of row y, many at a time, written into out, as if there 
+        // were no obstacles (from_x must be a multiple of ByteVector::WIDTH, the choices are from 
+        // GetCollisionChoices) (uses the byte-vector instructions, see ByteVector.h: only defined if 
+        // the compiler has them)
+        template<int N_STATES> void UpdateCellsVectorized(const StateGrid &in,StateGrid &out,int y,int from_x,int to_x,
+            const unsigned int *choice_bits,int n_words) const;
+
+        // the number of particles in a state, and its momentum along x (axis 0) or y (axis 1) in whole units
+        static constexpr int GetMass(state s);
+        static constexpr int GetMomentum(state s,int axis);
+        // do two states have the same mass and momentum?
+        static constexpr bool IsEquivalent(state s1,state s2);
+
+        // compile-time checks on a list of collision classes (see Rules): that each state is below n_states
+        // and in at most one class, and keeps its mass and momentum; and that the gas is collision-saturated
+        // (any two states that could be swapped are in the same class)
+        static constexpr bool IsConserving(const state *classes,int n_states);
+        static constexpr bool IsSaturated(const state *classes,int n_states);
 
         void ResizeGrid(int x_size,int y_size); // override
 
+        state GetBoundaryLinks(int x,int y) const; // override
+
 
     protected: // data
 
         const FHP_type fhp_type;
+        int n_states; // 64 without the rest particle, 128 with it
 
         static const state E=1, SE=2, SW=4, W=8, NW=16, NE=32, REST=64;
 
         vector< vector<state> > collision_classes;
-        state collision_map[129];
+
+        // Each cell makes its own random choice of outcome, if its state is in a class with more than
+        // two members: choice c moves the state 1+c%(n-1) places on around its class of n. (This picks
+        // each outcome equally often if n-1 divides N_COLLISION_CHOICES, as it does for all of ours.)
+        static const int N_COLLISION_CHOICES = 4;
+        state collision_maps[N_COLLISION_CHOICES][129];
+
+        // (the same, as a value that the compiler can build from a list of collision classes, see Rules)
+        struct CollisionMaps { state m[N_COLLISION_CHOICES][129]; };
+        static constexpr CollisionMaps MakeCollisionMaps(const state *classes);
 
         // an attempt to speed things up: can we store pointers to the 6 neighbors of each cell?
         //vector<vector<vector<state*> > > nbors_lut[2]; // [buffer][dir][x][y]
 };
 
+#endif
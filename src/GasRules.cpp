@@ -0,0 +1,415 @@
+/*
+    Lattice Gas Explorer
+    Copyright (C) 2008-2009 Tim J. Hutton <tim.hutton@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "GasRules.h"
+
+// STL:
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <stdexcept>
+using namespace std;
+
+// standard library:
+#include <stdio.h>
+#ifdef _WIN32
+    #include <process.h>
+    #define getpid _getpid
+#else
+    #include <unistd.h>
+#endif
+
+// The directions of the engines, one for each bit of a state: the file's directions are matched
+// to these by their vectors. (For hex as FHPLatticeGas, in the units of its GetMomentum, and for
+// square as the two types of HPPLatticeGas.)
+static const int HEX_DIRS[6][2] = { {2,0}, {1,1}, {-1,1}, {-2,0}, {-1,-1}, {1,-1} }; // E,SE,SW,W,NW,NE
+static const int HEX_REST = 64;
+static const int DIAGONAL_DIRS[4][2] = { {1,-1}, {1,1}, {-1,1}, {-1,-1} }; // NE,SE,SW,NW
+static const int HV_DIRS[4][2] = { {0,-1}, {1,0}, {0,1}, {-1,0} }; // N,E,S,W
+
+// the version of the cache format (change it whenever the format or the meaning of the rules changes)
+static const char CACHE_MAGIC[8] = { 'L','G','A','R','U','L','E','S' };
+static const uint32_t CACHE_VERSION = 1;
+
+// FNV-1a
+static uint64_t HashText(const string& text)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for(size_t i=0;i<text.size();i++)
+    {
+        h ^= (unsigned char)text[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static string Trim(const string& s)
+{
+    const size_t first = s.find_first_not_of(" \t\r");
+    if(first==string::npos) return "";
+    return s.substr(first,s.find_last_not_of(" \t\r")+1-first);
+}
+
+static void ThrowAtLine(int line,const string& message)
+{
+    ostringstream oss;
+    oss << "GasRules::Parse : line " << line << ": " << message;
+    throw runtime_error(oss.str());
+}
+
+GasRules::GasRules() : lattice(Lattice_Hex), diagonal(false), has_rest(false), saturated(false)
+{
+    MakeCollisionMaps();
+}
+
+int GasRules::GetNumStates() const
+{
+    if(this->lattice==Lattice_Square) return 16;
+    return this->has_rest ? 128 : 64;
+}
+
+void GasRules::Load(const string& filename)
+{
+    ifstream in(filename.c_str(),ios::binary);
+    if(!in)
+        throw runtime_error("GasRules::Load : failed to open "+filename);
+    ostringstream text;
+    text << in.rdbuf();
+
+    const string cache_filename = filename+".cache";
+    const uint64_t hash = HashText(text.str());
+    if(ReadCache(cache_filename,hash))
+        return; // (the rules were checked when the cache was made)
+
+    istringstream iss(text.str());
+    Parse(iss);
+    if(this->name.empty())
+        this->name = filename;
+    WriteCache(cache_filename,hash);
+}
+
+void GasRules::Parse(istream& in)
+{
+    struct Direction { string name; int dx,dy,line; };
+    vector<Direction> directions;
+    string rest_name;
+    vector<pair<string,int> > class_lines; // (parsed at the end, once the names are known)
+    bool have_lattice = false;
+
+    this->name = "";
+    this->has_rest = false;
+    this->saturated = false;
+    this->classes.clear();
+
+    string line;
+    for(int i_line=1;getline(in,line);i_line++)
+    {
+        line = Trim(line.substr(0,line.find('#')));
+        if(line.empty()) continue;
+        istringstream iss(line);
+        string keyword;
+        iss >> keyword;
+        if(keyword=="name")
+            this->name = Trim(line.substr(keyword.size()));
+        else if(keyword=="lattice")
+        {
+            string type;
+            iss >> type;
+            if(type=="hex") this->lattice = Lattice_Hex;
+            else if(type=="square") this->lattice = Lattice_Square;
+            else ThrowAtLine(i_line,"expected \"lattice hex\" or \"lattice square\"");
+            have_lattice = true;
+        }
+        else if(keyword=="direction")
+        {
+            Direction d;
+            d.line = i_line;
+            if(!(iss >> d.name >> d.dx >> d.dy))
+                ThrowAtLine(i_line,"expected \"direction <name> <dx> <dy>\"");
+            directions.push_back(d);
+        }
+        else if(keyword=="rest")
+        {
+            if(!rest_name.empty())
+                ThrowAtLine(i_line,"only one rest particle is supported");
+            if(!(iss >> rest_name))
+                ThrowAtLine(i_line,"expected \"rest <name>\"");
+        }
+        else if(keyword=="saturated")
+        {
+            string yes_no;
+            iss >> yes_no;
+            if(yes_no=="yes") this->saturated = true;
+            else if(yes_no=="no") this->saturated = false;
+            else ThrowAtLine(i_line,"expected \"saturated yes\" or \"saturated no\"");
+        }
+        else if(keyword=="class")
+            class_lines.push_back(make_pair(line.substr(keyword.size()),i_line));
+        else
+            ThrowAtLine(i_line,"unknown keyword \""+keyword+"\"");
+    }
+    if(!have_lattice)
+        throw runtime_error("GasRules::Parse : the rules don't say which lattice they are for");
+
+    // match the directions to the bits of the engine by their vectors
+    const int n_dirs = (this->lattice==Lattice_Hex) ? 6 : 4;
+    if((int)directions.size()!=n_dirs)
+        throw runtime_error(this->lattice==Lattice_Hex ? "GasRules::Parse : a hex lattice needs 6 directions"
+            : "GasRules::Parse : a square lattice needs 4 directions");
+    if(this->lattice==Lattice_Square)
+        this->diagonal = (directions[0].dx!=0 && directions[0].dy!=0);
+    const int (*engine_dirs)[2] = (this->lattice==Lattice_Hex) ? HEX_DIRS : (this->diagonal ? DIAGONAL_DIRS : HV_DIRS);
+    map<string,state> bits;
+    for(int i=0;i<n_dirs;i++)
+    {
+        const Direction &d = directions[i];
+        int bit = -1;
+        for(int dir=0;dir<n_dirs;dir++)
+            if(engine_dirs[dir][0]==d.dx && engine_dirs[dir][1]==d.dy)
+                bit = 1<<dir;
+        if(bit<0)
+            ThrowAtLine(d.line,(this->lattice==Lattice_Hex) ? "not one of the six directions of FHP"
+                : "not one of the four directions of HPP (and all must be diagonal, or none)");
+        for(map<string,state>::const_iterator it=bits.begin();it!=bits.end();it++)
+            if(it->second==bit)
+                ThrowAtLine(d.line,"the same direction is given twice");
+        if(bits.count(d.name))
+            ThrowAtLine(d.line,"the name \""+d.name+"\" is used twice");
+        bits[d.name] = bit;
+    }
+    if(!rest_name.empty())
+    {
+        if(this->lattice!=Lattice_Hex)
+            throw runtime_error("GasRules::Parse : a square lattice can't have a rest particle");
+        if(bits.count(rest_name))
+            throw runtime_error("GasRules::Parse : the name \""+rest_name+"\" is used twice");
+        bits[rest_name] = HEX_REST;
+        this->has_rest = true;
+    }
+
+    // now the classes: "A+B, C+D, ..."
+    for(size_t i=0;i<class_lines.size();i++)
+    {
+        const int i_line = class_lines[i].second;
+        vector<state> states;
+        istringstream iss(class_lines[i].first);
+        string state_text;
+        while(getline(iss,state_text,','))
+        {
+            state s = 0;
+            istringstream particles(state_text);
+            string particle;
+            while(getline(particles,particle,'+'))
+            {
+                particle = Trim(particle);
+                map<string,state>::const_iterator it = bits.find(particle);
+                if(it==bits.end())
+                    ThrowAtLine(i_line,"unknown particle \""+particle+"\"");
+                if(s & it->second)
+                    ThrowAtLine(i_line,"a state has \""+particle+"\" twice");
+                s |= it->second;
+            }
+            states.push_back(s);
+        }
+        if(states.size()<2)
+            ThrowAtLine(i_line,"a class needs at least two states");
+        if(this->lattice==Lattice_Square && states.size()!=2)
+            ThrowAtLine(i_line,"on a square lattice each class must be a pair");
+        this->classes.push_back(states);
+    }
+
+    Check();
+    MakeCollisionMaps();
+}
+
+int GasRules::GetMass(state s) const
+{
+    int mass = 0;
+    for(int bit=0;bit<8;bit++)
+        if(s & (1<<bit))
+            mass++;
+    return mass;
+}
+
+int GasRules::GetMomentum(state s,int axis) const
+{
+    const int n_dirs = (this->lattice==Lattice_Hex) ? 6 : 4;
+    const int (*dirs)[2] = (this->lattice==Lattice_Hex) ? HEX_DIRS : (this->diagonal ? DIAGONAL_DIRS : HV_DIRS);
+    int p = 0;
+    for(int dir=0;dir<n_dirs;dir++)
+        if(s & (1<<dir))
+            p += dirs[dir][axis]; // (a rest particle has none)
+    return p;
+}
+
+bool GasRules::IsEquivalent(state s1,state s2) const
+{
+    return GetMass(s1)==GetMass(s2) && GetMomentum(s1,0)==GetMomentum(s2,0) && GetMomentum(s1,1)==GetMomentum(s2,1);
+}
+
+void GasRules::Check() const
+{
+    // (the same checks as FHPLatticeGas makes on its built-in rules when they are compiled)
+    const int n_states = GetNumStates();
+    vector<int> class_of(n_states,-1);
+    for(size_t i=0;i<this->classes.size();i++)
+    {
+        const vector<state> &c = this->classes[i];
+        for(size_t j=0;j<c.size();j++)
+        {
+            if(c[j]>=n_states || class_of[c[j]]>=0)
+                throw runtime_error("GasRules::Check : a state is out of range or is listed twice");
+            class_of[c[j]] = (int)i;
+            if(!IsEquivalent(c[0],c[j]))
+                throw runtime_error("GasRules::Check : a collision would change the mass or momentum");
+        }
+    }
+    if(this->saturated)
+    {
+        // any two states with the same mass and momentum must be in the same class
+        for(int s1=0;s1<n_states;s1++)
+            for(int s2=s1+1;s2<n_states;s2++)
+                if(IsEquivalent(s1,s2) && (class_of[s1]<0 || class_of[s1]!=class_of[s2]))
+                    throw runtime_error("GasRules::Check : the rules are meant to be collision-saturated but a case is missing");
+    }
+}
+
+void GasRules::MakeCollisionMaps()
+{
+    for(int choice=0;choice<N_COLLISION_CHOICES;choice++)
+    {
+        for(int s=0;s<256;s++)
+            this->collision_maps[choice][s] = s; // default: no change
+        for(size_t i=0;i<this->classes.size();i++)
+        {
+            const vector<state> &c = this->classes[i];
+            const int n = (int)c.size();
+            const int move = 1 + choice%(n-1); // each i will become i+move mod n
+            for(int j=0;j<n;j++)
+                this->collision_maps[choice][c[j]] = c[(j+move)%n];
+        }
+    }
+}
+
+// The cache is in the byte order of the machine that wrote it (it is not meant to be shared):
+// the magic number and version, the hash of the text, the lattice, the name, then the classes
+// and the collision maps.
+
+bool GasRules::ReadCache(const string& filename,uint64_t hash)
+{
+    ifstream in(filename.c_str(),ios::binary);
+    if(!in) return false;
+    char magic[8];
+    uint32_t version;
+    uint64_t cached_hash;
+    in.read(magic,sizeof(magic));
+    in.read((char*)&version,sizeof(version));
+    in.read((char*)&cached_hash,sizeof(cached_hash));
+    if(!in || !equal(magic,magic+8,CACHE_MAGIC) || version!=CACHE_VERSION || cached_hash!=hash)
+        return false;
+    unsigned char flags[4];
+    uint32_t name_length,n_classes;
+    in.read((char*)flags,sizeof(flags));
+    in.read((char*)&name_length,sizeof(name_length));
+    if(!in || name_length>65536) return false;
+    string cached_name(name_length,' ');
+    if(name_length>0) in.read(&cached_name[0],name_length);
+    in.read((char*)&n_classes,sizeof(n_classes));
+    if(!in || n_classes>256) return false;
+    vector< vector<state> > cached_classes(n_classes);
+    for(uint32_t i=0;i<n_classes;i++)
+    {
+        unsigned char n = 0;
+        in.read((char*)&n,1);
+        cached_classes[i].resize(n);
+        if(n>0) in.read((char*)&cached_classes[i][0],n);
+    }
+    state maps[N_COLLISION_CHOICES][256];
+    in.read((char*)maps,sizeof(maps));
+    if(!in) return false;
+
+    // the file may be damaged (or the hash may collide), so check the rules as if we had just
+    // parsed them, and that the maps are the ones the classes give
+    GasRules cached;
+    cached.lattice = flags[0] ? Lattice_Hex : Lattice_Square;
+    cached.diagonal = flags[1]!=0;
+    cached.has_rest = flags[2]!=0;
+    cached.saturated = flags[3]!=0;
+    cached.name = cached_name;
+    cached.classes = cached_classes;
+    for(uint32_t i=0;i<n_classes;i++)
+        if(cached_classes[i].size()<2)
+            return false;
+    try
+    {
+        cached.Check();
+    }
+    catch(const runtime_error&)
+    {
+        return false;
+    }
+    cached.MakeCollisionMaps();
+    if(!equal(&maps[0][0],&maps[0][0]+N_COLLISION_CHOICES*256,&cached.collision_maps[0][0]))
+        return false;
+
+    *this = cached;
+    return true;
+}
+
+void GasRules::WriteCache(const string& filename,uint64_t hash) const
+{
+    // write to a file of our own and then rename it into place, so that another process loading
+    // the same rules never sees a half-written cache
+    ostringstream temp_filename;
+    temp_filename << filename << ".tmp." << getpid();
+    {
+        ofstream out(temp_filename.str().c_str(),ios::binary);
+        if(!out) return;
+        WriteCacheContents(out,hash);
+        if(!out)
+        {
+            out.close();
+            remove(temp_filename.str().c_str());
+            return;
+        }
+    }
+    if(rename(temp_filename.str().c_str(),filename.c_str())!=0)
+        remove(temp_filename.str().c_str()); // (e.g. on Windows, where another process got there first)
+}
+
+void GasRules::WriteCacheContents(ostream& out,uint64_t hash) const
+{
+    out.write(CACHE_MAGIC,sizeof(CACHE_MAGIC));
+    out.write((const char*)&CACHE_VERSION,sizeof(CACHE_VERSION));
+    out.write((const char*)&hash,sizeof(hash));
+    const unsigned char flags[4] = { (unsigned char)(this->lattice==Lattice_Hex), (unsigned char)this->diagonal,
+        (unsigned char)this->has_rest, (unsigned char)this->saturated };
+    out.write((const char*)flags,sizeof(flags));
+    const uint32_t name_length = (uint32_t)this->name.size();
+    out.write((const char*)&name_length,sizeof(name_length));
+    out.write(this->name.data(),name_length);
+    const uint32_t n_classes = (uint32_t)this->classes.size();
+    out.write((const char*)&n_classes,sizeof(n_classes));
+    for(uint32_t i=0;i<n_classes;i++)
+    {
+        const unsigned char n = (unsigned char)this->classes[i].size();
+        out.write((const char*)&n,1);
+        out.write((const char*)&this->classes[i][0],n);
+    }
+    out.write((const char*)this->collision_maps,sizeof(this->collision_maps));
+}
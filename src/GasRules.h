@@ -0,0 +1,131 @@
+/*
+    Lattice Gas Explorer
+    Copyright (C) 2008-2009 Tim J. Hutton <tim.hutton@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __GASRULES__
+#define __GASRULES__
+
+// standard library:
+#include <stdint.h>
+
+// STL:
+#include <string>
+#include <vector>
+#include <istream>
+#include <ostream>
+using std::string;
+using std::vector;
+using std::istream;
+using std::ostream;
+
+// The collision rules of a gas, read from a text file when the program runs, so that variants
+// can be tried without recompiling. The file lists the directions the particles move in, and
+// the collision classes in the same form as the FHP rules (see FHPLatticeGas.cpp), e.g.:
+//
+//     # FHP-I
+//     name FHP-I (rule file)
+//     lattice hex
+//     direction E 2 0
+//     direction SE 1 1
+//     direction SW -1 1
+//     direction W -2 0
+//     direction NW -1 -1
+//     direction NE 1 -1
+//     saturated no
+//     class E+W, NE+SW, NW+SE
+//     class E+NW+SW, W+NE+SE
+//
+// A hex lattice needs the six directions of FHP (in whole units: x scaled by 2 and y by 2/sqrt(3),
+// y pointing down) and may have one rest particle ("rest R"). A square lattice needs the four
+// directions of one of the HPP gases, and its classes must be pairs (the HPP engine makes no
+// random choices). The names and the order of the directions are up to the
+// file. Each class is a set of states that can be swapped at will: the rules are checked to
+// conserve mass and momentum (and, with "saturated yes", that no possible collision is missing),
+// and an engine then runs them from a table. (See the files in the rules folder.)
+class GasRules
+{
+    public: // typedefs
+
+        typedef unsigned char state;
+
+        enum TLattice { Lattice_Square, Lattice_Hex };
+
+        // each cell picks one of this many outcomes at random (see GetCollision)
+        static const int N_COLLISION_CHOICES = 4;
+
+    public: // functions
+
+        GasRules();
+
+        // read the rules from a file, and check them. The checked rules are cached in a binary file
+        // next to it (filename+".cache") and read from there next time, as long as the text hasn't
+        // changed. Throws runtime_error if the file can't be read or the rules are wrong.
+        void Load(const string& filename);
+
+        // read the rules from text (throws runtime_error, as Load, but doesn't use a cache)
+        void Parse(istream& in);
+
+        string GetName() const { return this->name; }
+        TLattice GetLattice() const { return this->lattice; }
+        // (a square lattice: do the particles move diagonally, rather than horizontally and vertically?)
+        bool IsDiagonal() const { return this->diagonal; }
+        bool HasRestParticle() const { return this->has_rest; }
+        bool IsSaturated() const { return this->saturated; }
+
+        // how many states a cell can have, not counting the boundary (64 or 128 for hex, 16 for square)
+        int GetNumStates() const;
+
+        // the collision classes, with the states in the bits of the engine that runs them:
+        // for hex as FHPLatticeGas (E,SE,SW,W,NW,NE,REST), and for square as HPPLatticeGas
+        const vector< vector<state> >& GetCollisionClasses() const { return this->classes; }
+
+        // what state s becomes for the given random choice: choice c moves a state 1+c%(n-1) places on
+        // around its class of n (as FHPLatticeGas) and leaves the other states alone
+        state GetCollision(int choice,state s) const { return this->collision_maps[choice][s]; }
+
+    protected: // functions
+
+        // the number of particles in a state, and its momentum along x (axis 0) or y (axis 1), in the
+        // units of the file
+        int GetMass(state s) const;
+        int GetMomentum(state s,int axis) const;
+        bool IsEquivalent(state s1,state s2) const;
+
+        // throw runtime_error if a state is out of range or in more than one class, if a class doesn't
+        // conserve mass and momentum, or if the rules say they are saturated but a collision is missing
+        void Check() const;
+
+        void MakeCollisionMaps();
+
+        // read the binary cache, if it was made from text with this hash and holds valid rules (returns
+        // false if not, leaving us unchanged)
+        bool ReadCache(const string& filename,uint64_t hash);
+        // (failing to write the cache is not an error: it is only there to save time)
+        void WriteCache(const string& filename,uint64_t hash) const;
+        void WriteCacheContents(ostream& out,uint64_t hash) const;
+
+    protected: // data
+
+        string name;
+        TLattice lattice;
+        bool diagonal,has_rest,saturated;
+
+        vector< vector<state> > classes;
+        state collision_maps[N_COLLISION_CHOICES][256];
+};
+
+#endif
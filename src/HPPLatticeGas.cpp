@@ -19,12 +19,15 @@
 #include "HPPLatticeGas.h"
 
 // STL:
+#include <algorithm>
 #include <map>
 #include <sstream>
+#include <stdexcept>
 using namespace std;
 
 // standard lib:
 #include <math.h>
+#include <string.h>
 #include <stdlib.h>
 
 // class member constants
@@ -62,56 +65,95 @@ HPPLatticeGas::HPPLatticeGas(HPP_type type) : hpp_type(type)
     }
 
     this->BOUNDARY = 1<<N_DIRS; // state 16 is the boundary
+    for(int c=0;c<16;c++)
+        this->collision_map[c] = PermuteMaintainingMomentum(c);
+}
+
+HPPLatticeGas::HPPLatticeGas(const GasRules& rules) : HPPLatticeGas(rules.IsDiagonal() ? Diagonal : HorizontalVertical)
+{
+    if(rules.GetLattice()!=GasRules::Lattice_Square)
+        throw runtime_error("HPPLatticeGas : these rules aren't for a square lattice");
+    // (the classes are all pairs, so every choice gives the same map)
+    for(int c=0;c<16;c++)
+        this->collision_map[c] = rules.GetCollision(0,c);
 }
 
 void HPPLatticeGas::UpdateGas()
 {
-    current_buffer = old_buffer;
-    old_buffer = 1-current_buffer;
+    UpdateAllRows();
+}
 
+void HPPLatticeGas::UpdateRows(const StateGrid &in,StateGrid &out,int from_y,int to_y,int iteration)
+{
     #pragma omp parallel for
-    for(int x=0;x<X;x++)
+    for(int y=from_y;y<to_y;y++)
     {
-        for(int y=0;y<Y;y++)
+        state *new_row = out.Row(y);
+        int link = this->first_boundary_link[y];
+        const int end_link = this->first_boundary_link[y+1];
+        for(int x=0;x<X;)
         {
-            if(force_flow && x==0)
+            // the tiles that can't change on this step are just copied over (see GetNextRun)
+            bool active;
+            const int end_x = GetNextRun(y,x,iteration,active);
+            if(!active)
             {
-                // the left-most column gets overwritten randomly, since we are simulating
-                // an infinite tube filled with moving gas
-                state s = this->grid[old_buffer][0][y];
-                if(s!=BOUNDARY)
-                    s = this->forward_flow_samples[rand()%this->forward_flow_samples.size()];
-                this->grid[current_buffer][0][y]=s;
-            }
-            else
-            {
-                state c = this->grid[old_buffer][x][y];
-                state new_state = c;
-                if(c!=BOUNDARY)
-                {
-                    new_state = 0;
-                    for(int dir=0;dir<N_DIRS;dir++)
-                    {
-                        // look for an inbound particle travelling in this direction
-                        state nbor = this->grid[old_buffer][(x+DIR[opposite_dir(dir)][0]+X)%X][(y+DIR[opposite_dir(dir)][1]+Y)%Y];
-                        if((nbor&(1<<dir)) || (nbor==BOUNDARY && (c&(1<<opposite_dir(dir)))))
-                            new_state |= 1<<dir;
-                    }
-                }
-                new_state = PermuteMaintainingMomentum(new_state);
-                this->grid[current_buffer][x][y] = new_state;
+                copy(in.Row(y)+x,in.Row(y)+end_x,new_row+x);
+                while(link<end_link && this->boundary_links[link].x<end_x)
+                    link++;
+                x = end_x;
+                continue;
             }
+            // move the particles as if there were no obstacles, then bounce back the ones that hit 
+            // one, and put the obstacles back (see FindBoundaryLinksIfNeeded)
+            const int from_x = x;
+            for(;x<end_x;x++)
+                new_row[x] = GetNewState(in,x,y,0);
+            for(;link<end_link && this->boundary_links[link].x<end_x;link++)
+                new_row[this->boundary_links[link].x] = GetNewState(in,this->boundary_links[link].x,y,this->boundary_links[link].links);
+            RestoreObstacles(new_row,y,from_x,end_x);
+        }
+        if(force_flow)
+        {
+            // the left-most column gets overwritten randomly, since we are simulating
+            // an infinite tube filled with moving gas
+            state s = in.At(0,y);
+            if(s!=BOUNDARY)
+                s = this->forward_flow_samples[GetRandom(Random_Inflow,0,y,iteration)%this->forward_flow_samples.size()];
+            new_row[0] = s;
         }
+        ClassifyRow(new_row,y,iteration+1);
     }
+}
 
-    this->iterations++;
-    this->need_recompute_flow = true;
-    this->need_redraw_images = true;
+BaseLatticeGas::state HPPLatticeGas::GetNewState(const StateGrid &in,int x,int y,state links) const
+{
+    const state c = in.At(x,y);
+    state new_state = 0;
+    for(int dir=0;dir<N_DIRS;dir++)
+    {
+        // look for an inbound particle travelling in this direction (an obstacle has none), or 
+        // if the neighbor is an obstacle then reverse one of our own particles
+        const int od = opposite_dir(dir);
+        new_state |= in.At(x+DIR[od][0],y+DIR[od][1]) & (1<<dir);
+        if(c & links & (1<<od))
+            new_state |= 1<<dir;
+    }
+    return this->collision_map[new_state];
+}
+
+BaseLatticeGas::state HPPLatticeGas::GetBoundaryLinks(int x,int y) const
+{
+    if(IsObstacle(x,y)) return 0;
+    state links = 0;
+    for(int dir=0;dir<N_DIRS;dir++)
+        if(IsObstacle(x+DIR[dir][0],y+DIR[dir][1]))
+            links |= 1<<dir;
+    return links;
 }
 
-RealPoint HPPLatticeGas::GetVelocityAt(int x,int y) const
+RealPoint HPPLatticeGas::GetVelocity(state s) const
 {
-    state s = this->grid[current_buffer][x][y];
     RealPoint v;
     for(int dir=0;dir<N_DIRS;dir++)
     {
@@ -173,9 +215,8 @@ float HPPLatticeGas::GetAverageInputNumParticlesPerCell() const
     return n_particles_counted / (float)this->forward_flow_samples.size();
 }
 
-int HPPLatticeGas::GetNumGasParticlesAt(int x,int y) const
+int HPPLatticeGas::GetNumGasParticlesInState(state s) const
 {
-    state s = this->grid[current_buffer][x][y];
     int n_gas_particles = 0;
     for(int dir=0;dir<N_DIRS;dir++)
         if(s & (1<<dir))
@@ -183,28 +224,26 @@ int HPPLatticeGas::GetNumGasParticlesAt(int x,int y) const
     return n_gas_particles;
 }
 
-int HPPLatticeGas::GetMaxNumGasParticlesAt(int x,int y) const
+int HPPLatticeGas::GetMaxNumGasParticlesInState(state s) const
 {
-    state s = this->grid[current_buffer][x][y];
     if(s==BOUNDARY) return 0;
     else return 4;
 }
 
-wxColour HPPLatticeGas::GetColour(int x, int y) const
+Colour HPPLatticeGas::GetColourOfState(state s,int /*x*/,int /*y*/,bool show_velocity) const
 {
-    state s = grid[current_buffer][x][y];
-    wxColour c;
-    if(s==0) c=wxColour(0,0,0);
-    else if(s==BOUNDARY) c=wxColour(120,120,120);
+    Colour c;
+    if(s==0) c=Colour(0,0,0);
+    else if(s==BOUNDARY) c=Colour(120,120,120);
     else {
-        if(this->show_gas_colours)
+        if(show_velocity)
         {
-            RealPoint v = GetVelocityAt(x,y);
+            RealPoint v = GetVelocity(s);
             c = GetVectorAngleColour(v.x,v.y);
         }
         else
         {
-            float density = GetNumGasParticlesAt(x,y) / (float)GetMaxNumGasParticlesAt(x,y);
+            float density = GetNumGasParticlesInState(s) / (float)GetMaxNumGasParticlesInState(s);
             c = GetDensityColour(density);
         }
     }
@@ -213,17 +252,18 @@ wxColour HPPLatticeGas::GetColour(int x, int y) const
 
 void HPPLatticeGas::InsertRandomParticle(int x,int y)
 {
-    this->grid[current_buffer][x][y] = ((rand()%50)==0)?(1<<(rand()%4)):0;
+    const unsigned int r = GetRandom(Random_Initialization,x,y);
+    this->grid[current_buffer].At(x,y) = ((r%50)==0)?(1<<((r/50)%4)):0;
 }
 
 void HPPLatticeGas::InsertRandomFlow(int x, int y)
 {
-    this->grid[current_buffer][x][y] = this->forward_flow_samples[rand()%this->forward_flow_samples.size()];
+    this->grid[current_buffer].At(x,y) = this->forward_flow_samples[GetRandom(Random_Initialization,x,y)%this->forward_flow_samples.size()];
 }
 
 void HPPLatticeGas::InsertRandomBackwardFlow(int x, int y)
 {
-    this->grid[current_buffer][x][y] = this->backward_flow_samples[rand()%this->backward_flow_samples.size()];
+    this->grid[current_buffer].At(x,y) = this->backward_flow_samples[GetRandom(Random_Initialization,x,y)%this->backward_flow_samples.size()];
 }
 
 string HPPLatticeGas::GetReport(state s) const
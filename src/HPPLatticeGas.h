@@ -16,9 +16,13 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#include "SquareGridLatticeGas.h"
+#ifndef __HPPLATTICEGAS__
+#define __HPPLATTICEGAS__
 
-class HPPLatticeGas : public SquareGridLatticeGas
+#include "BaseLatticeGas.h"
+#include "GasRules.h"
+
+class HPPLatticeGas : public BaseLatticeGas
 {
     public: // typedefs
 
@@ -27,23 +31,36 @@ class HPPLatticeGas : public SquareGridLatticeGas
     public: // functions
 
         HPPLatticeGas(HPP_type type);
+        // a gas with rules loaded at run time (throws runtime_error if they aren't for a square lattice)
+        HPPLatticeGas(const GasRules& rules);
 
         void UpdateGas(); // override
 
         RealPoint GetAverageInputFlowVelocityPerParticle() const; // override
         float GetAverageInputNumParticlesPerCell() const; // override
 
+        Colour GetColourOfState(state s,int x,int y,bool show_velocity) const; // override
+
     protected: // functions
 
         static state PermuteMaintainingMomentum(state c);
 
-        int GetNumGasParticlesAt(int x,int y) const; // override
-        int GetMaxNumGasParticlesAt(int x,int y) const; // override
+        bool CanUpdateRows() const { return true; } // override
+        void UpdateRows(const StateGrid &in,StateGrid &out,int from_y,int to_y,int iteration); // override
+
+        // the state of cell x,y on the next step, from in (whose halo must be up to date): bit d of links 
+        // is set if the neighbor in direction d is an obstacle (cell x,y mustn't be an obstacle itself)
+        state GetNewState(const StateGrid &in,int x,int y,state links) const;
+
+        state GetBoundaryLinks(int x,int y) const; // override
 
-        RealPoint GetVelocityAt(int x,int y) const; // override
-        wxColour GetColour(int x,int y) const; // override
         string GetReport(state s) const; // override
 
+        int GetNumGasParticlesInState(state s) const; // override
+        int GetMaxNumGasParticlesInState(state s) const; // override
+        RealPoint GetVelocity(state s) const;
+        RealPoint GetVelocity(state s,int /*x*/,int /*y*/) const { return GetVelocity(s); } // override
+
         void InsertRandomFlow(int x,int y); // override
         void InsertRandomBackwardFlow(int x,int y); // override
         void InsertRandomParticle(int x,int y); // override
@@ -52,7 +69,13 @@ class HPPLatticeGas : public SquareGridLatticeGas
 
         HPP_type hpp_type;
 
+        // what each state becomes when its particles collide (PermuteMaintainingMomentum, unless the 
+        // rules were loaded at run time)
+        state collision_map[16];
+
         static const int N_DIRS = 4; // how many directions do the particles travel in?
         int DIR[N_DIRS][2]; // what direction is each travelling in?
         static state opposite_dir(state s) { return (s+N_DIRS/2)%N_DIRS; }
 };
+
+#endif
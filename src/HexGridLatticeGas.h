@@ -19,19 +19,20 @@
 #ifndef __HEXGRIDLATTICEGAS__
 #define __HEXGRIDLATTICEGAS__
 
-#include "BaseLatticeGas_drawable.h"
+#include "BaseLatticeGas.h"
 
-class HexGridLatticeGas : public BaseLatticeGas_drawable
+class HexGridLatticeGas : public BaseLatticeGas
 {
     public: // functions
 
         HexGridLatticeGas();
-        
-        void RedrawImagesIfNeeded();
+
+        bool IsOnHexGrid() const { return true; } // override
 
     protected:
 
         RealPoint GetVelocity(state s) const;
+        RealPoint GetVelocity(state s,int /*x*/,int /*y*/) const { return GetVelocity(s); } // override
 
     protected: // data
 
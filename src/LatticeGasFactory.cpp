@@ -21,32 +21,45 @@
 #include "HPPLatticeGas.h"
 #include "FHPLatticeGas.h"
 #include "PairInteractionLatticeGas.h"
+#include "BitPlaneFHPLatticeGas.h"
+#include "BitPlaneHPPLatticeGas.h"
+#include "PackedPairInteractionLatticeGas.h"
+#include "GasRules.h"
 
 enum { GasType_HPP_diag, GasType_HPP_ortho, GasType_FHP_I, GasType_FHP_6,
-    GasType_FHP_II, GasType_FHP_III, GasType_PI, GasType_Kagome, GasType_LAST };
+    GasType_FHP_II, GasType_FHP_III, GasType_PI, GasType_FHP_I_bitplane, GasType_FHP_6_bitplane,
+    GasType_FHP_II_bitplane, GasType_FHP_III_bitplane, GasType_HPP_diag_bitplane, GasType_HPP_ortho_bitplane,
+    GasType_PI_packed, GasType_Kagome, GasType_LAST };
 
 int LatticeGasFactory::GetNumGasTypesSupported()
 {
     return GasType_LAST;
 }
 
-wxString LatticeGasFactory::GetGasDescription(int type)
+string LatticeGasFactory::GetGasDescription(int type)
 {
     switch(type)
     {
-        case GasType_HPP_diag: return _("HPP (diagonal movement)");
-        case GasType_HPP_ortho: return _("HPP (vertical/horizontal movement)");
-        case GasType_FHP_I: return _("FHP-I");
-        case GasType_FHP_6: return _("FHP6");
-        case GasType_FHP_II: return _("FHP-II");
-        case GasType_FHP_III: return _("FHP-III");
-        case GasType_PI: return _("Pair-Interaction");
-        case GasType_Kagome: return _("Kagome (Boghosian et al., 2002)");
-        default: return _("ERROR!");
+        case GasType_HPP_diag: return "HPP (diagonal movement)";
+        case GasType_HPP_ortho: return "HPP (vertical/horizontal movement)";
+        case GasType_FHP_I: return "FHP-I";
+        case GasType_FHP_6: return "FHP6";
+        case GasType_FHP_II: return "FHP-II";
+        case GasType_FHP_III: return "FHP-III";
+        case GasType_PI: return "Pair-Interaction";
+        case GasType_FHP_I_bitplane: return "FHP-I (bit-plane engine, slower than the byte engine on open flows)";
+        case GasType_FHP_6_bitplane: return "FHP6 (bit-plane engine, slower than the byte engine on open flows)";
+        case GasType_FHP_II_bitplane: return "FHP-II (bit-plane engine, slower than the byte engine on open flows)";
+        case GasType_FHP_III_bitplane: return "FHP-III (bit-plane engine, slower than the byte engine on open flows)";
+        case GasType_HPP_diag_bitplane: return "HPP (diagonal movement, bit-plane engine)";
+        case GasType_HPP_ortho_bitplane: return "HPP (vertical/horizontal movement, bit-plane engine)";
+        case GasType_PI_packed: return "Pair-Interaction (packed engine)";
+        case GasType_Kagome: return "Kagome (Boghosian et al., 2002)";
+        default: return "ERROR!";
     }
 }
 
-BaseLatticeGas_drawable* LatticeGasFactory::CreateGas(int type)
+BaseLatticeGas* LatticeGasFactory::CreateGas(int type)
 {
     switch(type)
     {
@@ -57,7 +70,27 @@ BaseLatticeGas_drawable* LatticeGasFactory::CreateGas(int type)
         case GasType_FHP_II: return new FHPLatticeGas(FHPLatticeGas::FHP_II); 
         case GasType_FHP_III: return new FHPLatticeGas(FHPLatticeGas::FHP_III); 
         case GasType_PI: return new PairInteractionLatticeGas(); 
+        case GasType_FHP_I_bitplane: return new BitPlaneFHPLatticeGas(FHPLatticeGas::FHP_I); 
+        case GasType_FHP_6_bitplane: return new BitPlaneFHPLatticeGas(FHPLatticeGas::FHP_6); 
+        case GasType_FHP_II_bitplane: return new BitPlaneFHPLatticeGas(FHPLatticeGas::FHP_II); 
+        case GasType_FHP_III_bitplane: return new BitPlaneFHPLatticeGas(FHPLatticeGas::FHP_III); 
+        case GasType_HPP_diag_bitplane: return new BitPlaneHPPLatticeGas(HPPLatticeGas::Diagonal); 
+        case GasType_HPP_ortho_bitplane: return new BitPlaneHPPLatticeGas(HPPLatticeGas::HorizontalVertical); 
+        case GasType_PI_packed: return new PackedPairInteractionLatticeGas(); 
         case GasType_Kagome: return NULL; // TODO!
         default: return NULL;
     }
 }
+
+BaseLatticeGas* LatticeGasFactory::CreateGasFromRuleFile(const string& filename,string& description)
+{
+    GasRules rules;
+    rules.Load(filename);
+    description = rules.GetName();
+    switch(rules.GetLattice())
+    {
+        case GasRules::Lattice_Hex: return new FHPLatticeGas(rules);
+        case GasRules::Lattice_Square: return new HPPLatticeGas(rules);
+        default: return NULL;
+    }
+}
@@ -17,16 +17,19 @@
 */
 
 // local:
-#include "wxWidgetsPreamble.h"
-#include "BaseLatticeGas_drawable.h"
+#include "BaseLatticeGas.h"
 
 class LatticeGasFactory
 {
 	public:
 
-		static BaseLatticeGas_drawable* CreateGas(int type);
+		static BaseLatticeGas* CreateGas(int type);
 
-        static wxString GetGasDescription(int type);
+        // a gas whose rules are read from a file (see GasRules): the engine is picked by the lattice
+        // the rules are for (throws runtime_error if the file can't be read or the rules are wrong)
+        static BaseLatticeGas* CreateGasFromRuleFile(const string& filename,string& description);
+
+        static string GetGasDescription(int type);
 
         static int GetNumGasTypesSupported();
 
@@ -0,0 +1,337 @@
+/*
+    Lattice Gas Explorer
+    Copyright (C) 2008-2009 Tim J. Hutton <tim.hutton@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "LatticeGasRenderer.h"
+
+// STL:
+#include <algorithm>
+#include <stdexcept>
+#include <exception>
+using namespace std;
+
+LatticeGasRenderer::LatticeGasRenderer(BaseLatticeGas *gas) : gas(gas),
+    zoom_factor_num(1), zoom_factor_denom(1), image_X(0), image_Y(0),
+    line_length(100), show_gas(true), show_gas_colours(false), show_grid(true), show_flow(true),
+    show_flow_colours(true), grid_lines_colour(100,100,100), need_redraw_images(true), drawn_num_changes(0)
+{
+}
+
+bool LatticeGasRenderer::RequestZoomFactor(int num,int denom)
+{
+    const int X = this->gas->GetX(), Y = this->gas->GetY();
+
+    // just check this wouldn't make too big an image (could only draw the bit we need to show, in future)
+    {
+        long int n_pixels = (X * num / denom)*(Y * num / denom);
+        if(n_pixels>10e6) return false;
+    }
+    this->zoom_factor_num = num;
+    this->zoom_factor_denom = denom;
+    this->image_X = X;
+    this->image_Y = Y;
+
+    // resize the images we draw into
+    this->drawing_bitmap.Create(X * this->zoom_factor_num / this->zoom_factor_denom,
+        Y * this->zoom_factor_num / this->zoom_factor_denom);
+    this->gas_image.Create(X * this->zoom_factor_num / this->zoom_factor_denom,
+        Y * this->zoom_factor_num / this->zoom_factor_denom);
+
+    // select a bitmap into the drawing buffer
+    this->drawing_buffer.SelectObject(this->drawing_bitmap);
+
+    this->need_redraw_images = true;
+
+    return true;
+}
+
+void LatticeGasRenderer::Draw(wxPaintDC& dc,int x_offset,int y_offset)
+{
+    this->RedrawImagesIfNeeded();
+    dc.Blit(x_offset,y_offset,this->drawing_bitmap.GetWidth(),this->drawing_bitmap.GetHeight(),
+        &this->drawing_buffer,0,0);
+}
+
+void LatticeGasRenderer::RequestBestFitZoomFactor(int x,int y)
+{
+    const int X = this->gas->GetX(), Y = this->gas->GetY();
+
+    // scale down the visible grid until we it is sensible to show
+    {
+        // try: 256,128,...,2,1,1/2,1/4,1/8,...
+        int zn=1<<8,zd=1;
+        while((X*zn)/zd>x || (Y*zn)/zd>y)
+        {
+            if(zn>1) zn/=2;
+            else zd*=2;
+        }
+        RequestZoomFactor(zn,zd);
+    }
+}
+
+bool LatticeGasRenderer::ZoomIn()
+{
+    if(this->zoom_factor_denom==1)
+        return this->RequestZoomFactor(this->zoom_factor_num*2,this->zoom_factor_denom);
+    else
+        return this->RequestZoomFactor(this->zoom_factor_num,this->zoom_factor_denom/2);
+}
+
+void LatticeGasRenderer::ZoomOut()
+{
+    if(this->zoom_factor_num>1) this->RequestZoomFactor(this->zoom_factor_num/2,this->zoom_factor_denom);
+    else this->RequestZoomFactor(this->zoom_factor_num,this->zoom_factor_denom*2);
+}
+
+void LatticeGasRenderer::GetZoom(int &num,int &denom) const
+{
+    num = this->zoom_factor_num;
+    denom = this->zoom_factor_denom;
+}
+
+bool LatticeGasRenderer::GetShowGas() const
+{
+    return this->show_gas;
+}
+
+void LatticeGasRenderer::SetShowGas(bool show)
+{
+    this->show_gas = show;
+    this->need_redraw_images = true;
+}
+
+bool LatticeGasRenderer::GetShowGasColours() const
+{
+    return this->show_gas_colours;
+}
+
+void LatticeGasRenderer::SetShowGasColours(bool show)
+{
+    this->show_gas_colours = show;
+    this->need_redraw_images = true;
+}
+
+double LatticeGasRenderer::GetLineLength() const
+{
+    return this->line_length;
+}
+
+void LatticeGasRenderer::SetLineLength(double ll)
+{
+    this->line_length = ll;
+    this->need_redraw_images = true;
+}
+
+bool LatticeGasRenderer::GetShowFlow() const
+{
+    return this->show_flow;
+}
+
+void LatticeGasRenderer::SetShowFlow(bool show)
+{
+    this->show_flow = show;
+    this->need_redraw_images = true;
+}
+
+bool LatticeGasRenderer::GetShowFlowColours() const
+{
+    return this->show_flow_colours;
+}
+
+void LatticeGasRenderer::SetShowFlowColours(bool show)
+{
+    this->show_flow_colours = show;
+    this->need_redraw_images = true;
+}
+
+bool LatticeGasRenderer::GetShowGrid() const
+{
+    return this->show_grid;
+}
+
+void LatticeGasRenderer::SetShowGrid(bool show)
+{
+    this->show_grid = show;
+    this->need_redraw_images = true;
+}
+
+void LatticeGasRenderer::SetDisplayForDemo(int i)
+{
+    switch(i)
+    {
+        case BaseLatticeGas::Demo_Particles:
+            this->line_length = 1;
+            this->show_flow_colours = true;
+            this->show_grid = true;
+            this->show_flow = true;
+            this->show_gas = true;
+            this->show_gas_colours = true;
+            break;
+        case BaseLatticeGas::Demo_Obstacle:
+        case BaseLatticeGas::Demo_Hole:
+        case BaseLatticeGas::Demo_KelvinHelmholtz:
+            this->line_length = 100;
+            this->show_flow_colours = true;
+            this->show_grid = true;
+            this->show_flow = true;
+            this->show_gas = true;
+            this->show_gas_colours = false;
+            break;
+        default:
+            throw runtime_error("LatticeGasRenderer::SetDisplayForDemo : demo range error");
+    }
+    this->need_redraw_images = true;
+}
+
+int LatticeGasRenderer::GetRowOffset(int y,double side) const
+{
+    if(!this->gas->IsOnHexGrid()) return 0;
+    return (int)((y%2)?side/4:-side/4);
+}
+
+void LatticeGasRenderer::RedrawImagesIfNeeded()
+{
+    // if the grid has been resized then we start again with a zoom that shows all of it
+    if(this->gas->GetX()!=this->image_X || this->gas->GetY()!=this->image_Y)
+        RequestBestFitZoomFactor(500,500);
+
+    if(!this->need_redraw_images && this->gas->GetNumChanges()==this->drawn_num_changes) return;
+    this->drawn_num_changes = this->gas->GetNumChanges();
+
+    if(this->show_gas)
+    {
+        if(this->zoom_factor_denom==1) // ie. zoomed in enough to see cells
+            DrawCells();
+        else // zoomed out beyond 1 pixel: show the density of the gas
+            DrawAverageColours();
+        this->drawing_buffer.DrawBitmap(wxBitmap(this->gas_image),0,0);
+    }
+    else // show_gas==false
+    {
+        this->drawing_buffer.SetBackground(*wxWHITE_BRUSH);
+        this->drawing_buffer.Clear();
+    }
+
+    if(this->show_flow)
+        DrawFlow();
+
+    this->need_redraw_images = false;
+}
+
+void LatticeGasRenderer::DrawCells()
+{
+    const int X = this->gas->GetX(), Y = this->gas->GetY();
+    const int side = this->zoom_factor_num; // (zoom_factor_denom is 1)
+    const int width = this->gas_image.GetWidth(), height = this->gas_image.GetHeight();
+    const int block = this->gas->GetCellBlockSize(); // (the grid lines go round each block)
+    const bool show_grid_lines = this->show_grid && side>=4;
+    vector<state> buffer(X);
+    vector<unsigned char> rgb(3*X);
+    for(int y=0;y<Y;y++)
+    {
+        this->gas->GetColoursOfRow(this->gas->GetStateRow(y,&buffer[0]),y,X,this->show_gas_colours,&rgb[0]);
+        const int x_offset = GetRowOffset(y,side);
+        const int from_y = y * side;
+        const int to_y = from_y + side;
+        for(int x=0;x<X;x++)
+        {
+            const unsigned char *c = &rgb[3*x];
+            // draw a filled rect (quickest this way)
+            const int from_x = x * side + x_offset;
+            const int to_x = from_x + side;
+            for(int i=max(0,from_x);i<min(width,to_x);i++)
+            {
+                for(int j=max(0,from_y);j<min(height,to_y);j++)
+                {
+                    // draw grid if zoomed in enough
+                    if(show_grid_lines && ((x%block==0 && i==from_x) || (y%block==0 && j==from_y)))
+                        this->gas_image.SetRGB(i,j,this->grid_lines_colour.Red(),this->grid_lines_colour.Green(),
+                            this->grid_lines_colour.Blue());
+                    else
+                        this->gas_image.SetRGB(i,j,c[0],c[1],c[2]);
+                }
+            }
+        }
+    }
+}
+
+void LatticeGasRenderer::DrawAverageColours()
+{
+    const int X = this->gas->GetX(), Y = this->gas->GetY();
+    const int width = this->drawing_bitmap.GetWidth();
+    vector<state> buffer(X);
+    vector<unsigned char> row_rgb(3*X);
+    vector<int> sums(4*width); // r,g,b,n for each pixel along the row
+    for(int py=0;py<this->drawing_bitmap.GetHeight();py++)
+    {
+        // add up the colours of the cells in the region of each pixel, a row of cells at a time
+        int y = py * this->zoom_factor_denom;
+        fill(sums.begin(),sums.end(),0);
+        for(int j=y;j<min(y+this->zoom_factor_denom,Y-1);j++)
+        {
+            this->gas->GetColoursOfRow(this->gas->GetStateRow(j,&buffer[0]),j,X,this->show_gas_colours,&row_rgb[0]);
+            for(int px=0;px<width;px++)
+            {
+                int x = px * this->zoom_factor_denom;
+                int *sum = &sums[4*px];
+                for(int i=x;i<min(x+this->zoom_factor_denom,X-1);i++)
+                {
+                    sum[0] += row_rgb[3*i];
+                    sum[1] += row_rgb[3*i+1];
+                    sum[2] += row_rgb[3*i+2];
+                    sum[3]++;
+                }
+            }
+        }
+        for(int px=0;px<width;px++)
+        {
+            const int *sum = &sums[4*px];
+            this->gas_image.SetRGB(px,py,sum[0]/sum[3],sum[1]/sum[3],sum[2]/sum[3]);
+        }
+    }
+}
+
+void LatticeGasRenderer::DrawFlow()
+{
+    const int X = this->gas->GetX(), Y = this->gas->GetY();
+    const double side = this->zoom_factor_num / (double)this->zoom_factor_denom;
+    const int S = this->gas->GetFlowSampleSeparation();
+
+    this->gas->ComputeFlowIfNeeded();
+
+    // draw flow vectors
+    if(!this->show_flow_colours)
+        this->drawing_buffer.SetPen(*wxBLACK_PEN);
+    for(int x=S;x<X-S;x+=S)
+    {
+        for(int y=S;y<Y-S;y+=S)
+        {
+            RealPoint v = this->gas->GetFlowAsRepresented(x/S,y/S);
+            if(this->show_flow_colours)
+            {
+                const Colour c = BaseLatticeGas::GetVectorAngleColour(v.x,v.y);
+                this->drawing_buffer.SetPen(wxPen(wxColour(c.r,c.g,c.b)));
+            }
+            const int x_offset = GetRowOffset(y,side);
+            this->drawing_buffer.DrawLine(
+                (x+0.5) * side + x_offset,
+                (y+0.5) * side,
+                (x+0.5+v.x*this->line_length) * side + x_offset,
+                (y+0.5+v.y*this->line_length) * side);
+        }
+    }
+}
@@ -16,24 +16,24 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#ifndef __BASELATTICEGAS_DRAWABLE__
-#define __BASELATTICEGAS_DRAWABLE__
+#ifndef __LATTICEGASRENDERER__
+#define __LATTICEGASRENDERER__
+
+// wxWidgets:
+#include "wxWidgetsPreamble.h"
 
 // local:
 #include "BaseLatticeGas.h"
 
-// STL:
-#include <algorithm>
-using std::min;
-using std::max;
-
-// Abstract base class for an entity that can be zoomed and redrawn (using wxWidgets)
-class BaseLatticeGas_drawable : public BaseLatticeGas
+// Draws a gas (using wxWidgets), zoomed in or out, with its flow on top. The gas knows nothing of
+// this: the renderer reads the cells and the flow through the gas's public functions, and redraws
+// its images when the gas has changed (see BaseLatticeGas::GetNumChanges) or the view settings have.
+class LatticeGasRenderer
 {
     public: // functions
 
-        BaseLatticeGas_drawable();
-        virtual ~BaseLatticeGas_drawable();
+        // (the gas must outlive the renderer)
+        LatticeGasRenderer(BaseLatticeGas *gas);
 
         bool ZoomIn();
         void ZoomOut();
@@ -41,9 +41,8 @@ class BaseLatticeGas_drawable : public BaseLatticeGas
         bool RequestZoomFactor(int num,int denom);
         void RequestBestFitZoomFactor(int x,int y);
 
-        virtual void RedrawImagesIfNeeded()=0;
         void Draw(wxPaintDC& dc,int x_offset,int y_offset);
-        
+
         bool GetShowGas() const;
         void SetShowGas(bool show);
         bool GetShowGasColours() const;
@@ -57,29 +56,49 @@ class BaseLatticeGas_drawable : public BaseLatticeGas
         bool GetShowGrid() const;
         void SetShowGrid(bool show);
 
-        void ResetGridForDemo(int i); // override
+        // choose the view settings that suit demo i (see BaseLatticeGas::ResetGridForDemo)
+        void SetDisplayForDemo(int i);
+
+    protected: // typedefs
+
+        typedef BaseLatticeGas::state state;
 
     protected: // functions
 
-        void ResizeGrid(int x_size,int y_size); // override
+        void RedrawImagesIfNeeded();
+
+        // for when we are zoomed in enough to see the cells: fill a rectangle for each one (a hex grid
+        // has every other row shifted by half a cell), with the grid lines on top
+        void DrawCells();
 
-        static wxColour GetVectorAngleColour(float x,float y);
-        static wxColour GetDensityColour(float density);
-        virtual wxColour GetColour(int x,int y) const =0;
+        // for when we are zoomed out beyond 1 pixel: set each pixel of gas_image to the average
+        // colour of the cells under it
+        void DrawAverageColours();
+
+        // draw a line for the flow at each of the gas's sample points
+        void DrawFlow();
+
+        // how far row y is shifted to the right, in pixels (for a hex grid)
+        int GetRowOffset(int y,double side) const;
 
     protected: // data
 
+        BaseLatticeGas *gas;
+
         wxImage gas_image;
-        wxBitmap drawing_bitmap; 
+        wxBitmap drawing_bitmap;
         wxMemoryDC drawing_buffer;
 
         int zoom_factor_num,zoom_factor_denom; // zoom is expressed as a rational
-        
-        // some flags for visual things, used in subclasses when output is graphical
+        int image_X,image_Y; // the size of the grid that the images were made for
+
         double line_length;
         bool show_gas,show_gas_colours,show_grid,show_flow,show_flow_colours;
-        
+
         wxColour grid_lines_colour;
+
+        bool need_redraw_images; // have the view settings changed since we last drew the images?
+        unsigned int drawn_num_changes; // (the gas's GetNumChanges when we last drew them)
 };
 
 #endif
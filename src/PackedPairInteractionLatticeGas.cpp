@@ -0,0 +1,239 @@
+/*
+    Lattice Gas Explorer
+    Copyright (C) 2008-2009 Tim J. Hutton <tim.hutton@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "PackedPairInteractionLatticeGas.h"
+
+// standard lib:
+#include <string.h>
+
+// SIMD:
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+using namespace std;
+
+PackedPairInteractionLatticeGas::PackedPairInteractionLatticeGas() : BX(0), BY(0)
+{
+    memset(this->pair_lut,0,sizeof(this->pair_lut));
+    for(int a=0;a<5;a++)
+    {
+        for(int b=0;b<5;b++)
+        {
+            this->pair_lut[0][a*5+b] = this->pi_table_horiz[a][b][0];
+            this->pair_lut[1][a*5+b] = this->pi_table_horiz[a][b][1];
+            this->pair_lut[2][a*5+b] = this->pi_table_vert[a][b][0];
+            this->pair_lut[3][a*5+b] = this->pi_table_vert[a][b][1];
+        }
+    }
+}
+
+void PackedPairInteractionLatticeGas::ResetGridForDemo(int i)
+{
+    // the demos are written into grid as usual, then we convert them
+    PairInteractionLatticeGas::ResetGridForDemo(i);
+    PackGrid();
+}
+
+void PackedPairInteractionLatticeGas::ResetGridForGeometry(int x_size,int y_size,const vector<bool>& is_obstacle,bool wind_tunnel)
+{
+    PairInteractionLatticeGas::ResetGridForGeometry(x_size,y_size,is_obstacle,wind_tunnel);
+    PackGrid();
+}
+
+void PackedPairInteractionLatticeGas::LoadCheckpoint(istream& in)
+{
+    PairInteractionLatticeGas::LoadCheckpoint(in);
+    PackGrid();
+}
+
+void PackedPairInteractionLatticeGas::PackGrid()
+{
+    // (we assume X and Y are even)
+    this->BX = X/2;
+    this->BY = Y/2;
+    for(int iBuffer=0;iBuffer<2;iBuffer++)
+        for(int p=0;p<N_POSITIONS;p++)
+            this->blocks[iBuffer][p].assign(BX*BY,0);
+    for(int y=0;y<Y;y++)
+    {
+        const state *row = this->grid[current_buffer].Row(y);
+        state *even = &this->blocks[current_buffer][2*(y%2)][(y/2)*BX];
+        state *odd = &this->blocks[current_buffer][1+2*(y%2)][(y/2)*BX];
+        for(int bx=0;bx<BX;bx++)
+        {
+            even[bx] = row[2*bx];
+            odd[bx] = row[2*bx+1];
+        }
+    }
+}
+
+void PackedPairInteractionLatticeGas::UpdateGas()
+{
+    current_buffer = old_buffer;
+    old_buffer = 1-current_buffer;
+
+    vector<state> *OldBlocks = this->blocks[old_buffer];
+    vector<state> *NewBlocks = this->blocks[current_buffer];
+
+    // -- phase 1: pairwise interactions, in x then y (all within a block) --
+
+    #pragma omp parallel for
+    for(int by=0;by<BY;by++)
+    {
+        state *TL = &OldBlocks[0][by*BX],*TR = &OldBlocks[1][by*BX];
+        state *BL = &OldBlocks[2][by*BX],*BR = &OldBlocks[3][by*BX];
+        ApplyPairwiseInteractions(TL,TR,BX,this->pair_lut[0],this->pair_lut[1]);
+        ApplyPairwiseInteractions(BL,BR,BX,this->pair_lut[0],this->pair_lut[1]);
+        ApplyPairwiseInteractions(TL,BL,BX,this->pair_lut[2],this->pair_lut[3]);
+        ApplyPairwiseInteractions(TR,BR,BX,this->pair_lut[2],this->pair_lut[3]);
+    }
+
+    // -- phase 2: transport --
+
+    #pragma omp parallel for
+    for(int by=0;by<BY;by++)
+    {
+        for(int p=0;p<N_POSITIONS;p++)
+        {
+            // every particle in position p moves one block in direction (mx,my)
+            const int o = p^3; // (the diagonally opposite position in the block)
+            const int mx = (p&1)?1:-1, my = (p&2)?1:-1;
+            const state *P_minus = &OldBlocks[p][((by-my+BY)%BY)*BX];
+            const state *P_plus = &OldBlocks[p][((by+my+BY)%BY)*BX];
+            const state *O_minus = &OldBlocks[o][((by-my+BY)%BY)*BX];
+            const state *O_here = &OldBlocks[o][by*BX];
+            const state *O_plus = &OldBlocks[o][((by+my+BY)%BY)*BX];
+            const state *D = &OldBlocks[p][by*BX];
+            state *out = &NewBlocks[p][by*BX];
+            // the blocks away from the left and right edges can be done in one run
+            if(BX>2)
+                PullTransport(p,out+1,D+1,P_minus+1-mx,P_plus+1+mx,O_minus+1-mx,O_here+1,O_plus+1+mx,BX-2);
+            // the edge blocks need their neighbours wrapping around
+            for(int bx=0;bx<BX;bx+=max(1,BX-1))
+            {
+                const int bx_minus = (bx-mx+BX)%BX, bx_plus = (bx+mx+BX)%BX;
+                PullTransport(p,out+bx,D+bx,P_minus+bx_minus,P_plus+bx_plus,O_minus+bx_minus,O_here+bx,O_plus+bx_plus,1);
+            }
+        }
+    }
+
+    if(this->force_flow)
+    {
+        // the left-most column is overwritten, since we are modelling flow in an infinite tube
+        for(int y=0;y<Y;y++)
+        {
+            state &s = NewBlocks[2*(y%2)][(y/2)*BX];
+            if(s!=BOUNDARY) s = 0;
+        }
+        vector<unsigned int> inflow(Y);
+        GetRandomColumn(Random_Inflow,1,0,Y,&inflow[0]);
+        for(int y=0;y<Y;y++)
+        {
+            state &s = NewBlocks[1+2*(y%2)][(y/2)*BX];
+            if(s!=BOUNDARY) s = this->forward_flow_samples[inflow[y]%this->forward_flow_samples.size()]; // only flow to the right
+        }
+    }
+    this->iterations++;
+    this->need_recompute_flow = true;
+    this->n_changes++;
+}
+
+void PackedPairInteractionLatticeGas::ApplyPairwiseInteractions(state *a,state *b,int n,
+    const state *table_a,const state *table_b) const
+{
+    int i=0;
+#ifdef __SSSE3__
+    // 16 pairs at a time: the 25-entry tables are looked up with two byte shuffles each
+    const __m128i boundary = _mm_set1_epi8(BOUNDARY);
+    const __m128i fifteen = _mm_set1_epi8(15);
+    const __m128i ta_lo = _mm_loadu_si128((const __m128i*)table_a);
+    const __m128i ta_hi = _mm_loadu_si128((const __m128i*)(table_a+16));
+    const __m128i tb_lo = _mm_loadu_si128((const __m128i*)table_b);
+    const __m128i tb_hi = _mm_loadu_si128((const __m128i*)(table_b+16));
+    for(;i+16<=n;i+=16)
+    {
+        const __m128i va = _mm_loadu_si128((const __m128i*)(a+i));
+        const __m128i vb = _mm_loadu_si128((const __m128i*)(b+i));
+        const __m128i va2 = _mm_add_epi8(va,va);
+        const __m128i index = _mm_add_epi8(_mm_add_epi8(va2,va2),_mm_add_epi8(va,vb)); // a*5+b
+        const __m128i upper = _mm_cmpgt_epi8(index,fifteen);
+        __m128i na = _mm_or_si128(_mm_and_si128(upper,_mm_shuffle_epi8(ta_hi,index)),
+            _mm_andnot_si128(upper,_mm_shuffle_epi8(ta_lo,index)));
+        __m128i nb = _mm_or_si128(_mm_and_si128(upper,_mm_shuffle_epi8(tb_hi,index)),
+            _mm_andnot_si128(upper,_mm_shuffle_epi8(tb_lo,index)));
+        // no interactions at boundaries
+        const __m128i inert = _mm_or_si128(_mm_cmpeq_epi8(va,boundary),_mm_cmpeq_epi8(vb,boundary));
+        na = _mm_or_si128(_mm_and_si128(inert,va),_mm_andnot_si128(inert,na));
+        nb = _mm_or_si128(_mm_and_si128(inert,vb),_mm_andnot_si128(inert,nb));
+        _mm_storeu_si128((__m128i*)(a+i),na);
+        _mm_storeu_si128((__m128i*)(b+i),nb);
+    }
+#endif
+    for(;i<n;i++)
+    {
+        if(a[i]==BOUNDARY || b[i]==BOUNDARY) continue; // no interactions at boundaries
+        const int index = a[i]*5+b[i];
+        a[i] = table_a[index];
+        b[i] = table_b[index];
+    }
+}
+
+void PackedPairInteractionLatticeGas::PullTransport(int p,state *out,const state *d,const state *pm,const state *pp,
+    const state *om,const state *o0,const state *op,int n) const
+{
+    // For a cell in position p of block b, where particles in position p move by m and o is the opposite
+    // position, the candidates are the same as in PairInteractionLatticeGas::UpdateGas:
+    // - direct: the particle at (p,b-m) arrives here
+    // - bounce: the particle at (o,b+m) can't reach (o,b) so moves here instead
+    // - bounce back: the particle at (o,b) can't reach (o,b-m) or (p,b-m) so moves here instead
+    // - trapped: our own particle can't reach (p,b+m), (o,b+m) or (o,b) so stays here
+    // (pm,pp are position p at b-m,b+m; om,o0,op are position o at b-m,b,b+m)
+    // Only direct+bounce and direct+trapped can coincide, and in the original one particle overwrites
+    // the other, in the order of the x coordinate of where they came from. We do the same.
+    // (the loop is written with masks rather than branches so that the compiler can vectorize it)
+    const state B = BOUNDARY;
+    const state direct_wins = (p&1) ? 0 : 0xFF; // for odd x, the particle from the left arrives first so the other one wins
+    for(int i=0;i<n;i++)
+    {
+        const state s_d = d[i], s_pm = pm[i], s_pp = pp[i], s_om = om[i], s_o0 = o0[i], s_op = op[i];
+        const state direct = -(state)((s_pm!=0) & (s_pm!=B));
+        const state bounce = -(state)((s_op!=0) & (s_op!=B) & (s_o0==B));
+        const state bounce_back = -(state)((s_o0!=0) & (s_o0!=B) & (s_om==B) & (s_pm==B));
+        const state trapped = -(state)((s_d!=0) & (s_pp==B) & (s_op==B) & (s_o0==B));
+        // (bounce_back excludes the other three, and bounce and trapped exclude each other)
+        const state other = (bounce_back & s_o0) | (bounce & s_op) | (trapped & s_d);
+        const state other_mask = bounce_back | bounce | trapped;
+        const state s = (direct & (direct_wins | ~other_mask) & s_pm) | (~(direct & direct_wins) & other);
+        const state is_boundary = -(state)(s_d==B);
+        out[i] = (is_boundary & B) | (~is_boundary & s);
+    }
+}
+
+const BaseLatticeGas::state* PackedPairInteractionLatticeGas::GetStateRow(int y,state *buffer) const
+{
+    // (the even and odd cells of the row are in two of the blocks' positions)
+    const state *even = &this->blocks[current_buffer][2*(y%2)][(y/2)*BX];
+    const state *odd = &this->blocks[current_buffer][1+2*(y%2)][(y/2)*BX];
+    for(int bx=0;bx<BX;bx++)
+    {
+        buffer[2*bx] = even[bx];
+        buffer[2*bx+1] = odd[bx];
+    }
+    return buffer;
+}
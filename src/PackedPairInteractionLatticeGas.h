@@ -0,0 +1,69 @@
+/*
+    Lattice Gas Explorer
+    Copyright (C) 2008-2009 Tim J. Hutton <tim.hutton@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __PACKEDPAIRINTERACTIONLATTICEGAS__
+#define __PACKEDPAIRINTERACTIONLATTICEGAS__
+
+#include "PairInteractionLatticeGas.h"
+
+// The same gas as PairInteractionLatticeGas but stored by 2x2 block: the four cells of
+// each block live at the same index in four arrays, one per position in the block. The pair
+// interactions are then between whole arrays (applied with byte shuffles where SSSE3 is
+// available), and since every particle in a given position moves one block diagonally,
+// transport becomes a branch-free pull from the neighbouring block rows.
+class PackedPairInteractionLatticeGas : public PairInteractionLatticeGas
+{
+    public:
+
+        PackedPairInteractionLatticeGas();
+
+        void UpdateGas(); // override
+
+        void ResetGridForDemo(int i); // override
+        void ResetGridForGeometry(int x_size,int y_size,const vector<bool>& is_obstacle,bool wind_tunnel=true); // override
+        void LoadCheckpoint(istream& in); // override
+
+    protected: // functions
+
+        bool CanUpdateRows() const { return false; } // override (we keep our cells in the blocks)
+
+        const state* GetStateRow(int y,state *buffer) const; // override
+
+        // copy the contents of grid[current_buffer] into the blocks
+        void PackGrid();
+
+        // apply the pair interactions to n blocks, where a,b are the arrays of the two cells in each pair
+        void ApplyPairwiseInteractions(state *a,state *b,int n,const state *table_a,const state *table_b) const;
+
+        // compute the new contents of n cells in position p, by pulling from their sources
+        void PullTransport(int p,state *out,const state *d,const state *pm,const state *pp,
+            const state *om,const state *o0,const state *op,int n) const;
+
+    protected: // data
+
+        // the position of a cell in its block is (x%2)+2*(y%2): TL=0, TR=1, BL=2, BR=3
+        static const int N_POSITIONS = 4;
+
+        int BX,BY; // the size of the grid in blocks
+        vector<state> blocks[2][N_POSITIONS]; // [buffer][position][by*BX+bx]
+
+        // pi_table_horiz and pi_table_vert, laid out for lookup by a*5+b:
+        state pair_lut[4][32]; // horiz. a, horiz. b, vert. a, vert. b
+};
+
+#endif
@@ -20,6 +20,7 @@
 
 // STL:
 #include <map>
+#include <algorithm>
 using namespace std;
 
 // standard lib:
@@ -110,100 +111,174 @@ PairInteractionLatticeGas::PairInteractionLatticeGas()
 
 void PairInteractionLatticeGas::UpdateGas()
 {
-    current_buffer = old_buffer;
-    old_buffer = 1-current_buffer;
-
-    vector<vector<state> > &OldBuffer = this->grid[old_buffer];
-    vector<vector<state> > &NewBuffer = this->grid[current_buffer];
-
-    // -- phase 1: pairwise interactions, in x then y --
-
-    #pragma omp parallel for
-    for(int x=0;x<X;x+=2) // (we assume X is even)
-        for(int y=0;y<Y;y++)
-            ApplyHorizontalPairwiseInteraction(OldBuffer[x][y],OldBuffer[x+1][y]);
-    #pragma omp parallel for
-    for(int x=0;x<X;x++)
-        for(int y=0;y<Y;y+=2) // (we assume Y is even)
-            ApplyVerticalPairwiseInteraction(OldBuffer[x][y],OldBuffer[x][y+1]);
-
-    // -- phase 2: simple transport --
-
-    // start with an empty grid
-    #pragma omp parallel for
-    for(int x=0;x<X;x++)
-       std::fill(NewBuffer[x].begin(),NewBuffer[x].end(),0);
+    UpdateAllRows();
+}
 
-    #pragma omp parallel for
-    for(int x=0;x<X;x++)
+void PairInteractionLatticeGas::UpdateRows(const StateGrid &in,StateGrid &out,int from_y,int to_y,int iteration)
+{
+    // We do the whole step in one sweep down the grid, a pair of rows (a row of 2x2 blocks) at a
+    // time: each cell pulls in whichever particle arrives there (see PullTransport), from the
+    // block rows above and below after their pair interactions. Each thread keeps the last three
+    // block rows it has interacted, so every block row only passes through the cache once or twice.
+    const int BY = Y/2; // (we assume X and Y are even)
+    const int W = X+2*INTERACTED_HALO;
+    #pragma omp parallel
     {
-        // (need to declare these things here else omp causes problems)
-        int sx,sy;
-        state s,s2;
-        for(int y=0;y<Y;y++)
+        // three interacted block rows, each of two rows of W cells (block row b is kept in slot b%3)
+        vector<state> interacted(3*2*W);
+        int last_by = -2; // (the last block row we did, if we are carrying on from it)
+        const state *rows[6]; // rows 2*by-2 to 2*by+3, after the interactions
+        const state *window[6];
+
+        #pragma omp for schedule(static)
+        for(int by=from_y/2;by<to_y/2;by++)
         {
-            s = OldBuffer[x][y];
-            if(s==BOUNDARY)
-                NewBuffer[x][y]=BOUNDARY;      // boundaries don't change
-            else if(s>0)
+            // bring in the interacted block rows we need: by-1, by and by+1
+            for(int b=(by==last_by+1)?by+1:by-1;b<=by+1;b++)
+                InteractBlockRow(in,(b+BY)%BY,&interacted[((b+3)%3)*2*W],W,iteration);
+            last_by = by;
+            for(int j=0;j<6;j++)
+                rows[j] = &interacted[(((by-1+j/2)+3)%3)*2*W + (j%2)*W + INTERACTED_HALO];
+
+            for(int py=0;py<2;py++)
             {
-                // try simple transport
-                // we compute where this particle might go to: sx,sy
-                if(x%2) sx=x+2; else sx=x-2;
-                if(y%2) sy=y+2; else sy=y-2;
-                //if(sx>=X) sx-=X; else if(sx<0) sx+=X; // left-right wraps around
-                //if(sy>=Y) sy-=3; else if(sy<0) sy+=3; // top-bottom bounces (no-slip)
-                BringInside(sx,sy);
-                // retrieve the contents of the destination square
-                s2 = OldBuffer[sx][sy];
-                if(s2!=BOUNDARY)
-                    NewBuffer[sx][sy]=s; // simple transport
-                else {
-                    // we've got some bouncing to do
-                    // try the square in between
-                    if(x%2) sx=x+1; else sx=x-1;
-                    if(y%2) sy=y+1; else sy=y-1;
-                    BringInside(sx,sy);
-                    //if(sx>=X) sx-=X; else if(sx<0) sx+=X; // left-right wraps around
-                    //if(sy>=Y) sy-=1; else if(sy<0) sy+=1; // top-bottom bounces (no-slip)
-                    s2 = OldBuffer[sx][sy];
-                    if(s2!=BOUNDARY)
-                        NewBuffer[sx][sy]=s; // bounce transport
+                // the particles in row y move vertically by my, so we pass PullTransport the rows
+                // in order along that direction: y-3*my to y+2*my
+                const int y = 2*by+py, my = py?1:-1;
+                for(int k=-3;k<=2;k++)
+                    window[k+3] = rows[2+py+k*my];
+                state *new_row = out.Row(y);
+                int link = this->first_boundary_link[y];
+                const int end_link = this->first_boundary_link[y+1];
+                for(int x=0;x<X;)
+                {
+                    // the tiles that can't change on this step are just copied over (see GetNextRun)
+                    bool active;
+                    const int end_x = GetNextRun(y,x,iteration,active);
+                    if(active)
+                    {
+                        // move the particles as if there were no obstacles, then redo the pairs of cells
+                        // that are near one, which include the obstacles (see FindBoundaryLinksIfNeeded)
+                        MoveParticles(new_row,window,x,end_x);
+                        for(;link<end_link && this->boundary_links[link].x<end_x;link++)
+                            PullTransport(new_row,window,this->boundary_links[link].x,this->boundary_links[link].x+2);
+                    }
                     else
                     {
-                        // try to bounce back
-                        if(x%2) sx=x-1; else sx=x+1;
-                        if(y%2) sy=y-1; else sy=y+1;
-                        //if(sx>=X) sx-=X; else if(sx<0) sx+=X; // left-right wraps around
-                        //if(sy>=Y) sy-=1; else if(sy<0) sy+=1; // top-bottom bounces (no-slip)
-                        BringInside(sx,sy);
-                        s2 = OldBuffer[sx][sy];
-                        if(s2!=BOUNDARY)
-                            NewBuffer[sx][sy]=s; // bounce back transport
-                        else
-                            NewBuffer[x][y]=s; // particle is trapped here!
+                        copy(in.Row(y)+x,in.Row(y)+end_x,new_row+x);
+                        while(link<end_link && this->boundary_links[link].x<end_x)
+                            link++;
                     }
+                    x = end_x;
                 }
+
+                if(this->force_flow)
+                {
+                    // the left-most column is overwritten, since we are modelling flow in an infinite tube
+                    if(new_row[0]!=BOUNDARY)
+                        new_row[0] = 0; // only flow to the right
+                    if(new_row[1]!=BOUNDARY)
+                        new_row[1] = this->forward_flow_samples[GetRandom(Random_Inflow,1,y,iteration)%this->forward_flow_samples.size()];
+                }
+                ClassifyRow(new_row,y,iteration+1);
             }
         }
     }
-    if(this->force_flow)
+}
+
+void PairInteractionLatticeGas::InteractBlockRow(const StateGrid &in,int by,state *interacted,int W,int iteration)
+{
+    state *row = interacted + INTERACTED_HALO;
+    state *next_row = row + W;
+    copy(in.Row(2*by),in.Row(2*by)+X,row);
+    copy(in.Row(2*by+1),in.Row(2*by+1)+X,next_row);
+
+    // pairwise interactions, in x then y (the blocks are 2x2 so a tile with no particles in either 
+    // row has nothing to do, see ClassifyRow)
+    const int n_tiles = (X+TILE-1)/TILE;
+    const unsigned char *flags = &this->tile_flags[iteration%2][2*by*n_tiles];
+    for(int tile_x=0;tile_x<n_tiles;tile_x++)
     {
-        // the left-most column is overwritten, since we are modelling flow in an infinite tube
-        for(int x=0;x<2;x++)
+        if(!((flags[tile_x] | flags[n_tiles+tile_x]) & Tile_Gas))
+            continue;
+        const int from_x = tile_x*TILE, to_x = min(X,from_x+TILE);
+        for(int x=from_x;x<to_x;x+=2) // (we assume X is even)
         {
-            for(int y=0;y<Y;y++)
-            {
-                if(OldBuffer[x][y]==BOUNDARY)
-                    NewBuffer[x][y] = BOUNDARY;
-                else
-                    NewBuffer[x][y] = (x%2)?this->forward_flow_samples[rand()%this->forward_flow_samples.size()]:0; // only flow to the right
-            }
+            ApplyHorizontalPairwiseInteraction(row[x],row[x+1]);
+            ApplyHorizontalPairwiseInteraction(next_row[x],next_row[x+1]);
+        }
+        for(int x=from_x;x<to_x;x++)
+            ApplyVerticalPairwiseInteraction(row[x],next_row[x]);
+    }
+
+    // wrap around at the left and right
+    for(int r=0;r<2;r++)
+    {
+        state *cells = interacted + r*W + INTERACTED_HALO;
+        copy(cells+X-INTERACTED_HALO,cells+X,cells-INTERACTED_HALO);
+        copy(cells,cells+INTERACTED_HALO,cells+X);
+    }
+}
+
+void PairInteractionLatticeGas::PullTransport(state *out,const state * const *window,int from_x,int to_x) const
+{
+    // Each particle moves two cells diagonally, away from the other cells of its 2x2 block: (mx,my),
+    // which depends only on where it is. If that cell is a boundary it tries to bounce to the cell in 
+    // between, then back to the opposite cell of its block, and if it can't go there either it stays 
+    // put. Looking back from the cell at x (where particles move by m, and o is at x-m) the candidates are:
+    // - direct: the particle at x-2m arrives here
+    // - bounce: the particle at x+m can't reach x-m so moves here instead
+    // - bounce back: the particle at x-m can't reach x-3m or x-2m so moves here instead
+    // - trapped: our own particle can't reach x+2m, x+m or x-m so stays here
+    // (window[k+3] is the row that is k rows away in the direction of m)
+    // Only direct+bounce and direct+trapped can coincide, and then one particle overwrites the other,
+    // in the order that the original implementation moved them: by the x coordinate of where they came from.
+    // (the loop is written with masks rather than branches so that the compiler can vectorize it)
+    const state B = BOUNDARY;
+    const int n = to_x; // (a local copy, since the compiler must assume that writing to out might change it)
+    for(int px=0;px<2;px++)
+    {
+        const int mx = px?1:-1;
+        const state direct_wins = px ? 0 : 0xFF; // for odd x, the particle from the left arrives first so the other one wins
+        const state *om = window[0] - 3*mx, *pm = window[1] - 2*mx, *o0 = window[2] - mx;
+        const state *d = window[3], *op = window[4] + mx, *pp = window[5] + 2*mx;
+        for(int x=from_x+px;x<n;x+=2)
+        {
+            const state s_d = d[x], s_pm = pm[x], s_pp = pp[x], s_om = om[x], s_o0 = o0[x], s_op = op[x];
+            const state direct = -(state)((s_pm!=0) & (s_pm!=B));
+            const state bounce = -(state)((s_op!=0) & (s_op!=B) & (s_o0==B));
+            const state bounce_back = -(state)((s_o0!=0) & (s_o0!=B) & (s_om==B) & (s_pm==B));
+            const state trapped = -(state)((s_d!=0) & (s_pp==B) & (s_op==B) & (s_o0==B));
+            // (bounce_back excludes the other three, and bounce and trapped exclude each other)
+            const state other = (bounce_back & s_o0) | (bounce & s_op) | (trapped & s_d);
+            const state other_mask = bounce_back | bounce | trapped;
+            const state s = (direct & (direct_wins | ~other_mask) & s_pm) | (~(direct & direct_wins) & other);
+            const state is_boundary = -(state)(s_d==B);
+            out[x] = (is_boundary & B) | (~is_boundary & s); // boundaries don't change
         }
     }
-    this->iterations++;
-    this->need_recompute_flow = true;
-    this->need_redraw_images = true;
+}
+
+void PairInteractionLatticeGas::MoveParticles(state *out,const state * const *window,int from_x,int to_x)
+{
+    // (for even x the particles move by -1 in x, for odd x by +1, see PullTransport)
+    const state *from = window[1];
+    for(int x=from_x;x<to_x;x+=2)
+    {
+        out[x] = from[x+2];
+        out[x+1] = from[x-1];
+    }
+}
+
+BaseLatticeGas::state PairInteractionLatticeGas::GetBoundaryLinks(int x,int y) const
+{
+    if(x%2) return 0;
+    // PullTransport looks up to three cells away from each cell, in x and y
+    for(int j=y-3;j<=y+3;j++)
+        for(int i=x-3;i<=x+4;i++)
+            if(IsObstacle(i,j))
+                return 1;
+    return 0;
 }
 
 void PairInteractionLatticeGas::ApplyHorizontalPairwiseInteraction(state &a,state &b)
@@ -263,23 +338,20 @@ float PairInteractionLatticeGas::GetAverageInputNumParticlesPerCell() const
     return (n_counted/2.0) / this->forward_flow_samples.size(); // because we leave one column empty
 }
 
-int PairInteractionLatticeGas::GetNumGasParticlesAt(int x,int y) const
+int PairInteractionLatticeGas::GetNumGasParticlesInState(state s) const
 {
-    state s = this->grid[current_buffer][x][y];
     if(s>=1 && s<=4) return 1;
     else return 0;
 }
 
-int PairInteractionLatticeGas::GetMaxNumGasParticlesAt(int x,int y) const
+int PairInteractionLatticeGas::GetMaxNumGasParticlesInState(state s) const
 {
-    state s = this->grid[current_buffer][x][y];
     if(s==BOUNDARY) return 0;
     else return 1;
 }
 
-RealPoint PairInteractionLatticeGas::GetVelocityAt(int x,int y) const
+RealPoint PairInteractionLatticeGas::GetVelocity(state s,int x,int y) const
 {
-    state s = grid[current_buffer][x][y];
     switch(s)
     {
         default: return RealPoint(0,0);
@@ -290,22 +362,21 @@ RealPoint PairInteractionLatticeGas::GetVelocityAt(int x,int y) const
     }
 }
 
-wxColour PairInteractionLatticeGas::GetColour(int x,int y) const
+Colour PairInteractionLatticeGas::GetColourOfState(state s,int x,int y,bool show_velocity) const
 {
-    state s = grid[current_buffer][x][y];
-    wxColour c;
-    if(s==0) c=wxColour(0,0,0);
-    else if(s==1) c=wxColour(200,200,200);
-    else if(s==BOUNDARY) c=wxColour(120,120,120);
+    Colour c;
+    if(s==0) c=Colour(0,0,0);
+    else if(s==1) c=Colour(200,200,200);
+    else if(s==BOUNDARY) c=Colour(120,120,120);
     else {
-        if(this->show_gas_colours)
+        if(show_velocity)
         {
-            RealPoint v = GetVelocityAt(x,y);
+            RealPoint v = GetVelocity(s,x,y);
             c = GetVectorAngleColour(v.x,v.y);
         }
         else
         {
-            float density = GetNumGasParticlesAt(x,y) / (float)GetMaxNumGasParticlesAt(x,y);
+            float density = GetNumGasParticlesInState(s) / (float)GetMaxNumGasParticlesInState(s);
             c = GetDensityColour(density);
         }
     }
@@ -314,17 +385,18 @@ wxColour PairInteractionLatticeGas::GetColour(int x,int y) const
 
 void PairInteractionLatticeGas::InsertRandomParticle(int x,int y)
 {
-    this->grid[current_buffer][x][y] = ((rand()%100)==0)?(rand()%5):0; // sparse atoms
+    const unsigned int r = GetRandom(Random_Initialization,x,y);
+    this->grid[current_buffer].At(x,y) = ((r%100)==0)?((r/100)%5):0; // sparse atoms
 }
 
 void PairInteractionLatticeGas::InsertRandomFlow(int x, int y)
 {
-    this->grid[current_buffer][x][y] = (x%2)?this->forward_flow_samples[rand()%this->forward_flow_samples.size()]:0; // flow
+    this->grid[current_buffer].At(x,y) = (x%2)?this->forward_flow_samples[GetRandom(Random_Initialization,x,y)%this->forward_flow_samples.size()]:0; // flow
 }
 
 void PairInteractionLatticeGas::InsertRandomBackwardFlow(int x, int y)
 {
-    this->grid[current_buffer][x][y] = (1-(x%2))?this->forward_flow_samples[rand()%this->forward_flow_samples.size()]:0; // flow
+    this->grid[current_buffer].At(x,y) = (1-(x%2))?this->forward_flow_samples[GetRandom(Random_Initialization,x,y)%this->forward_flow_samples.size()]:0; // flow
 }
 
 string PairInteractionLatticeGas::GetReport(state s) const
@@ -332,116 +404,3 @@ string PairInteractionLatticeGas::GetReport(state s) const
     return "TODO"; // TODO
 }
 
-// we only need to override this to draw a more widely spaced grid, should split this up a bit
-void PairInteractionLatticeGas::RedrawImagesIfNeeded()
-{
-    if(!this->need_redraw_images) return;
-
-    if(this->show_gas)
-    {
-        if(this->zoom_factor_denom==1) // ie. zoomed in enough to see cells
-        {
-            for(int x=0;x<X;x++)
-            {
-                for(int y=0;y<Y;y++)
-                {
-                    wxColour c = GetColour(x,y);
-                    // draw a filled rect (quickest this way)
-                    for(int i=x * this->zoom_factor_num / this->zoom_factor_denom;i<(x+1) * this->zoom_factor_num / this->zoom_factor_denom;i++)
-                    {
-                        for(int j=y*this->zoom_factor_num / this->zoom_factor_denom;j<(y+1)*this->zoom_factor_num / this->zoom_factor_denom;j++)
-                        {
-						    // draw grid if zoomed in enough
-						    if(this->show_grid && this->zoom_factor_num>=4 && 
-							    ((x%2==0 && i==x * this->zoom_factor_num / this->zoom_factor_denom) ||
-							    (y%2==0 && j==y * this->zoom_factor_num / this->zoom_factor_denom) ))
-								    gas_image.SetRGB(i,j,grid_lines_colour.Red(),grid_lines_colour.Green(),grid_lines_colour.Blue());
-						    else
-							    gas_image.SetRGB(i,j,c.Red(),c.Green(),c.Blue());
-                        }
-                    }
-                }
-            }
-        }
-        else // zoomed out beyond 1 pixel: show the density of the gas
-        {
-            // for each pixel:
-            for(int px=0;px<this->drawing_bitmap.GetWidth();px++)
-            {
-                for(int py=0;py<this->drawing_bitmap.GetHeight();py++)
-                {
-                    int x = px * this->zoom_factor_denom;
-                    int y = py * this->zoom_factor_denom;
-                    // find the average colour for the cells in this region
-                    int r=0,g=0,b=0,n=0;
-                    for(int i=x;i<min(x+this->zoom_factor_denom,X-1);i++)
-                    {
-                        for(int j=y;j<min(y+this->zoom_factor_denom,Y-1);j++)
-                        {
-                            wxColour c = GetColour(i,j);
-                            r+=c.Red();
-                            g+=c.Green();
-                            b+=c.Blue();
-                            n++;
-                        }
-                    }
-                    wxColour c = wxColour(r/n,g/n,b/n);
-                    gas_image.SetRGB(px,py,c.Red(),c.Green(),c.Blue());
-                }
-            }
-        }
-        this->drawing_buffer.DrawBitmap(wxBitmap(gas_image),0,0);
-    }
-    else // show_gas==false
-    {
-        this->drawing_buffer.SetBackground(*wxWHITE_BRUSH);
-        this->drawing_buffer.Clear();
-    }
-
-    if(show_flow)
-    {
-        // draw the flow image
-        if(need_recompute_flow)
-            ComputeFlow();
-
-        // draw flow vectors
-        if(!this->show_flow_colours)
-            this->drawing_buffer.SetPen(*wxBLACK_PEN);
-        for(int x=this->flow_sample_separation;x<X-this->flow_sample_separation;x+=this->flow_sample_separation)
-        {
-            for(int y=this->flow_sample_separation;y<Y-this->flow_sample_separation;y+=this->flow_sample_separation)
-            {
-                int sx=x/this->flow_sample_separation,sy=y/this->flow_sample_separation;
-                RealPoint v(velocity[sx][sy]);
-                if(this->velocity_representation == Velocity_SubtractGlobalMean)
-                {
-                    // we subtract the averaged velocity at this point, to better highlight the dynamic changes
-                    v.x -= global_mean_velocity.x;
-                    v.y -= global_mean_velocity.y;
-                }
-                else if(this->velocity_representation == Velocity_SubtractPointMean)
-                {
-                    // we subtract the averaged velocity at this point, to better highlight the dynamic changes
-                    v.x -= averaged_velocity[sx][sy].x;
-                    v.y -= averaged_velocity[sx][sy].y;
-                }
-                if(this->show_flow_colours)
-                    this->drawing_buffer.SetPen(wxPen(GetVectorAngleColour(v.x,v.y)));
-                this->drawing_buffer.DrawLine((x+0.5) * this->zoom_factor_num / this->zoom_factor_denom,
-                    (y+0.5) * this->zoom_factor_num / this->zoom_factor_denom,
-                    (x+0.5+v.x*this->line_length)*this->zoom_factor_num / this->zoom_factor_denom,
-                    (y+0.5+v.y*this->line_length)*this->zoom_factor_num / this->zoom_factor_denom);
-            }
-        }
-    }
-
-    /* we can save images to make an animation but this is currently dormant
-    if(this->save_images)
-    {
-        SetStatusTextHelper sth(_("Saving image snapshot..."),this);
-        this->drawing_bitmap.SaveFile(wxString::Format(_("%04d.jpg"),this->n_saved_images++),wxBITMAP_TYPE_JPEG);
-    }*/
-
-    this->need_redraw_images = false;
-}
-
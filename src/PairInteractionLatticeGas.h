@@ -16,9 +16,12 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#include "SquareGridLatticeGas.h"
+#ifndef __PAIRINTERACTIONLATTICEGAS__
+#define __PAIRINTERACTIONLATTICEGAS__
 
-class PairInteractionLatticeGas : public SquareGridLatticeGas
+#include "BaseLatticeGas.h"
+
+class PairInteractionLatticeGas : public BaseLatticeGas
 {
     public:
   
@@ -30,30 +33,57 @@ class PairInteractionLatticeGas : public SquareGridLatticeGas
 
         float GetAverageInputNumParticlesPerCell() const; // override
 
+        // (the velocity and colour of a PI-LGA state depend on where it is)
+        Colour GetColourOfState(state s,int x,int y,bool show_velocity) const; // override
+
+        int GetCellBlockSize() const { return 2; } // override (the interactions pair up the cells)
+
     protected: // functions
 
-        wxColour GetColour(int x,int y) const; // override
-        RealPoint GetVelocityAt(int x,int y) const; // override
         string GetReport(state s) const; // override
 
         void ApplyHorizontalPairwiseInteraction(state &a,state &b);
         void ApplyVerticalPairwiseInteraction(state &a,state &b);
 
+        bool CanUpdateRows() const { return true; } // override
+        void UpdateRows(const StateGrid &in,StateGrid &out,int from_y,int to_y,int iteration); // override
+
+        // copy block row by (rows 2*by and 2*by+1) of in into interacted, two rows of W cells
+        // (from x=-INTERACTED_HALO), and apply the pairwise interactions to it (in the tiles that
+        // have particles on the given iteration)
+        void InteractBlockRow(const StateGrid &in,int by,state *interacted,int W,int iteration);
+
+        // compute the new contents of cells from_x to to_x-1 of a row by pulling in the particles that 
+        // arrive at each cell (window[k+3] is the interacted row k rows on in the direction that the 
+        // row's particles move; from_x must be even)
+        void PullTransport(state *out,const state * const *window,int from_x,int to_x) const;
+
+        // the same, for cells that are out of reach of any obstacle: every particle moves straight to the
+        // cell two away, diagonally
+        static void MoveParticles(state *out,const state * const *window,int from_x,int to_x);
+
+        // the cell pairs at even x and x+1 that are near an obstacle have links (odd x has none)
+        state GetBoundaryLinks(int x,int y) const; // override
+
         static int swap23(int x);
 
-        int GetNumGasParticlesAt(int x,int y) const; // override
-        int GetMaxNumGasParticlesAt(int x,int y) const; // override
+        int GetNumGasParticlesInState(state s) const; // override
+        int GetMaxNumGasParticlesInState(state s) const; // override
+        RealPoint GetVelocity(state s,int x,int y) const; // override
 
         void InsertRandomFlow(int x,int y); // override
         void InsertRandomBackwardFlow(int x,int y); // override
         void InsertRandomParticle(int x,int y); // override
-        
-        void RedrawImagesIfNeeded(); // override
+
+        int GetHaloWidth() const { return 2; } // override (particles can move two cells in one step)
 
     protected: // data
 
         // states: 0=empty, 1=rest particle, 2="x-mover", 3="y-mover", 4="diag-mover", 5=boundary
         state pi_table_horiz[5][5][2],pi_table_vert[5][5][2]; //  maps a,b onto pi_table[a][b][0],pi_table[a][b][1]
 
+        static const int INTERACTED_HALO = 2; // (a cell pulls from at most two cells beyond the edge, since X is even)
+
 };
 
+#endif
@@ -0,0 +1,131 @@
+/*
+    Lattice Gas Explorer
+    Copyright (C) 2008-2009 Tim J. Hutton <tim.hutton@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "StateGrid.h"
+
+// standard library:
+#include <stddef.h>
+
+// STL:
+#include <algorithm>
+#include <stdexcept>
+using namespace std;
+
+StateGrid::StateGrid() : X(0), Y(0), HALO(0), stride(0), origin(NULL), origin_shift(0)
+{
+}
+
+StateGrid::StateGrid(const StateGrid& g) : X(0), Y(0), HALO(0), stride(0), origin(NULL), origin_shift(0)
+{
+    *this = g;
+}
+
+StateGrid& StateGrid::operator=(const StateGrid& g)
+{
+    if(this!=&g)
+    {
+        // (a copy of cells need not be aligned in the same way, so we copy the rows into fresh storage)
+        Resize(g.X,g.Y,g.HALO);
+        if(this->origin)
+            copy(g.origin-HALO*stride-HALO,g.origin+(Y+HALO)*stride,this->origin-HALO*stride-HALO);
+    }
+    return *this;
+}
+
+void StateGrid::Resize(int x_size,int y_size,int halo)
+{
+    this->X = x_size;
+    this->Y = y_size;
+    this->HALO = halo;
+    // each row is ALIGNMENT-aligned, and the halo cells to the left of x=0 sit in the padding at the 
+    // end of the row before
+    this->stride = ((X+2*HALO+ALIGNMENT-1)/ALIGNMENT)*ALIGNMENT;
+    this->cells.assign((Y+4*HALO)*stride+2*ALIGNMENT,0); // (including the spare rows)
+    SetOrigin();
+}
+
+void StateGrid::RefreshHalo()
+{
+    if(this->HALO==0 || this->origin==NULL) return;
+    // first the left and right sides of each row
+    for(int y=0;y<Y;y++)
+    {
+        state *row = Row(y);
+        copy(row+X-HALO,row+X,row-HALO);
+        copy(row,row+HALO,row+X);
+    }
+    // then the rows above and below (which include the corners)
+    for(int i=1;i<=HALO;i++)
+    {
+        copy(Row(Y-i)-HALO,Row(Y-i)+X+HALO,Row(-i)-HALO);
+        copy(Row(i-1)-HALO,Row(i-1)+X+HALO,Row(Y+i-1)-HALO);
+    }
+}
+
+void StateGrid::RefreshHalo(int from_y,int to_y)
+{
+    if(this->HALO==0 || this->origin==NULL) return;
+    for(int y=from_y;y<to_y;y++)
+    {
+        state *row = Row(y);
+        copy(row+X-HALO,row+X,row-HALO);
+        copy(row,row+HALO,row+X);
+        if(y<HALO)
+            copy(row-HALO,row+X+HALO,Row(Y+y)-HALO);
+        if(y>=Y-HALO)
+            copy(row-HALO,row+X+HALO,Row(y-Y)-HALO);
+    }
+}
+
+void StateGrid::Fill(state s)
+{
+    if(this->origin)
+        fill(this->origin-HALO*stride-HALO,this->origin+(Y+HALO)*stride,s);
+}
+
+void StateGrid::MoveOrigin(int dy)
+{
+    if((dy!=-1 && dy!=1) || (this->origin_shift+dy*HALO)*(this->origin_shift+dy*HALO)>HALO*HALO || this->cells.empty())
+        throw runtime_error("StateGrid::MoveOrigin : can only move a grid back and forth by HALO rows");
+    this->origin += dy*HALO*this->stride;
+    this->origin_shift += dy*HALO;
+}
+
+void StateGrid::SetView(const StateGrid &g,int y,state *row)
+{
+    this->X = g.X;
+    this->Y = g.Y;
+    this->HALO = g.HALO;
+    this->stride = g.stride;
+    this->cells.clear();
+    this->origin = row - y*this->stride;
+    this->origin_shift = 0;
+}
+
+void StateGrid::SetOrigin()
+{
+    if(this->cells.empty())
+    {
+        this->origin = NULL;
+        return;
+    }
+    // (we leave room before the first row for the spare rows and the halo above it, and the halo cells to its left)
+    state *start = &this->cells[0];
+    this->origin = start + (ALIGNMENT - (size_t)start%ALIGNMENT)%ALIGNMENT + ALIGNMENT + 2*HALO*stride;
+    this->origin_shift = 0;
+}
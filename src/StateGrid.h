@@ -0,0 +1,102 @@
+/*
+    Lattice Gas Explorer
+    Copyright (C) 2008-2009 Tim J. Hutton <tim.hutton@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __STATEGRID__
+#define __STATEGRID__
+
+// STL:
+#include <vector>
+using std::vector;
+
+// A lattice of one-byte cell states, stored in a single block of memory one row after
+// another (so x is the fast index). Each row starts on an ALIGNMENT-byte boundary, which
+// leaves a few unused bytes at the end of each row: use GetStride() to step between rows.
+//
+// The grid is surrounded by a halo of ghost cells, HALO deep on every side, so that cells
+// from -HALO to X+HALO-1 (and likewise in y) can be read. An update loop can then find the
+// neighbors of every cell by plain pointer offsets: RefreshHalo() fills the halo with copies
+// of the cells on the opposite face, for a grid that wraps around. (A part of a larger,
+// decomposed domain would instead fill its halo with the edges of its neighbors.)
+//
+// There are HALO spare rows beyond the halo at the top and bottom, so that the whole grid can be 
+// moved up or down in memory by HALO rows, for updating the cells in place (see MoveOrigin). 
+// A grid can also be a view onto cells that belong to someone else (see SetView).
+class StateGrid
+{
+    public: // typedefs
+
+        typedef unsigned char state;
+        static const int ALIGNMENT = 64;
+
+    public: // functions
+
+        StateGrid();
+        StateGrid(const StateGrid& g);
+        StateGrid& operator=(const StateGrid& g);
+
+        // resize the grid to the specified size, setting every cell to zero
+        // (halo must be between 0 and ALIGNMENT)
+        void Resize(int x_size,int y_size,int halo=1);
+
+        // copy the cells on each face into the halo on the opposite side
+        void RefreshHalo();
+
+        // the same, for just the rows from_y to to_y-1: copy their ends into the halo at the sides,
+        // and copy any rows that are on the top or bottom face into the halo on the opposite side
+        void RefreshHalo(int from_y,int to_y);
+
+        // set every cell to s
+        void Fill(state s);
+
+        // say that the cells are now HALO rows further up (dy=-1) or down (dy=1) in memory: the grid 
+        // can be moved from where Resize put it and back again (so dy must alternate between -1 and 1)
+        void MoveOrigin(int dy);
+        int GetOriginShift() const { return this->origin_shift; } // (in rows: -HALO, 0 or HALO)
+
+        // make this grid a view with the same size and layout as g, but whose row y is at row (and the 
+        // other rows follow on, with g's stride) - no cells are owned, and only the rows that are in 
+        // someone's memory can be used (views can't be copied)
+        void SetView(const StateGrid &g,int y,state *row);
+
+        int GetX() const { return this->X; }
+        int GetY() const { return this->Y; }
+        int GetStride() const { return this->stride; }
+        int GetHalo() const { return this->HALO; }
+
+        state* Row(int y) { return this->origin + y*this->stride; }
+        const state* Row(int y) const { return this->origin + y*this->stride; }
+
+        state& At(int x,int y) { return this->origin[y*this->stride+x]; }
+        const state& At(int x,int y) const { return this->origin[y*this->stride+x]; }
+
+    protected: // functions
+
+        // find where cell 0,0 goes in cells (leaving room for the halo, and aligning the rows)
+        void SetOrigin();
+
+    protected: // data
+
+        int X,Y;
+        int HALO; // the depth of the ghost cells around the edge
+        int stride; // the distance between the start of one row and the next
+        vector<state> cells; // (over-allocated, so that we can align the rows)
+        state *origin; // cell 0,0 (the halo is before and after it)
+        int origin_shift; // how many rows the cells have been moved from where Resize put them
+};
+
+#endif
@@ -23,6 +23,7 @@
 
 // local:
 #include "LatticeGasFactory.h"
+#include "LatticeGasRenderer.h"
 
 // STL:
 #include <stdexcept>
@@ -91,6 +92,7 @@ public:
     void OnUpdateDemoN(wxUpdateUIEvent& event);
     void OnChangeToGasTypeN(wxCommandEvent& event);
     void OnUpdateChangeToGasTypeN(wxUpdateUIEvent& event);
+    void OnLoadRuleFile(wxCommandEvent& event);
     void OnGetReport(wxCommandEvent& event);
     // help menu
     void OnAbout(wxCommandEvent& event);
@@ -103,8 +105,10 @@ private:
     bool is_running;
     int running_step;
 
-    int current_gas_type;
-    BaseLatticeGas_drawable *gas;
+    int current_gas_type; // (-1 for a gas loaded from a rule file)
+    wxString rule_file_gas_description;
+    BaseLatticeGas *gas;
+    LatticeGasRenderer *renderer; // (draws the gas)
 
     int current_demo;
     void LoadCurrentDemo();
@@ -159,6 +163,7 @@ enum
     ID_GAS_TYPE_0,
     ID_MAX_GAS_TYPE = ID_GAS_TYPE_0 + 100,
 
+    ID_LOAD_RULE_FILE,
     ID_GET_REPORT,
 
     // help menu:
@@ -206,6 +211,7 @@ BEGIN_EVENT_TABLE(MyFrame, wxFrame)
     EVT_UPDATE_UI(ID_STEP,MyFrame::OnUpdateStep)
     EVT_MENU(ID_RUN_OR_STOP,MyFrame::OnRunOrStop)
     // (no demos or gas types here; we manually add them in the constructor)
+    EVT_MENU(ID_LOAD_RULE_FILE,MyFrame::OnLoadRuleFile)
     EVT_MENU(ID_GET_REPORT,MyFrame::OnGetReport)
     // help menu:
     EVT_MENU(ID_GETTING_STARTED,MyFrame::OnGettingStarted)
@@ -252,6 +258,12 @@ bool MyApp::OnInit()
 // main frame
 // ----------------------------------------------------------------------------
 
+// (the gases describe themselves in plain strings, having no dependency on wxWidgets)
+static wxString ToWxString(const string& s)
+{
+    return wxGetTranslation(wxString(s.c_str(),wxConvUTF8));
+}
+
 // frame constructor
 MyFrame::MyFrame(const wxString& title)
        : wxFrame(NULL, wxID_ANY, title)
@@ -292,7 +304,7 @@ MyFrame::MyFrame(const wxString& title)
             throw runtime_error("Internal error: need more velocity representation IDs!");
         for(int i=0;i<BaseLatticeGas::GetNumVelocityRepresentations();i++)
         {
-            viewMenu->AppendRadioItem(ID_VELOCITY_REPRESENTATION_0+i,BaseLatticeGas::GetVelocityRepresentationAsString(i),_("Switch to this representation of velocity"));
+            viewMenu->AppendRadioItem(ID_VELOCITY_REPRESENTATION_0+i,ToWxString(BaseLatticeGas::GetVelocityRepresentationAsString(i)),_("Switch to this representation of velocity"));
             Connect(ID_VELOCITY_REPRESENTATION_0+i,wxEVT_COMMAND_MENU_SELECTED,wxCommandEventHandler(MyFrame::OnChangeToVelocityRepresentationN));
             Connect(ID_VELOCITY_REPRESENTATION_0+i,wxEVT_UPDATE_UI,wxUpdateUIEventHandler(MyFrame::OnUpdateVelocityRepresentationN));
             // (alternative to using the static event table above)
@@ -314,7 +326,7 @@ MyFrame::MyFrame(const wxString& title)
             for(int i=0;i<BaseLatticeGas::GetNumDemos();i++)
             {
                 // add the item to the submenu and manually connect the events
-                demosMenu->AppendRadioItem(ID_DEMO_0+i,BaseLatticeGas::GetDemoDescription(i),_("Switch to this demo"));
+                demosMenu->AppendRadioItem(ID_DEMO_0+i,ToWxString(BaseLatticeGas::GetDemoDescription(i)),_("Switch to this demo"));
                 Connect(ID_DEMO_0+i,wxEVT_COMMAND_MENU_SELECTED,wxCommandEventHandler(MyFrame::OnDemoN));
                 Connect(ID_DEMO_0+i,wxEVT_UPDATE_UI,wxUpdateUIEventHandler(MyFrame::OnUpdateDemoN));
                 // (alternative to using the static event table above)
@@ -329,13 +341,14 @@ MyFrame::MyFrame(const wxString& title)
             for(int i=0;i<LatticeGasFactory::GetNumGasTypesSupported();i++)
             {
                 // add the item to the submenu and manually connect the events
-                gasTypeMenu->AppendRadioItem(ID_GAS_TYPE_0+i,LatticeGasFactory::GetGasDescription(i),_("Switch to this gas type"));
+                gasTypeMenu->AppendRadioItem(ID_GAS_TYPE_0+i,ToWxString(LatticeGasFactory::GetGasDescription(i)),_("Switch to this gas type"));
                 Connect(ID_GAS_TYPE_0+i,wxEVT_COMMAND_MENU_SELECTED,wxCommandEventHandler(MyFrame::OnChangeToGasTypeN));
                 Connect(ID_GAS_TYPE_0+i,wxEVT_UPDATE_UI,wxUpdateUIEventHandler(MyFrame::OnUpdateChangeToGasTypeN));
                 // (alternative to using the static event table above)
             }
             actionsMenu->AppendSubMenu(gasTypeMenu,_("Gas type:"));
         }
+        actionsMenu->Append(ID_LOAD_RULE_FILE,_("Load gas rules..."),_("Switch to a gas whose rules are read from a file"));
         actionsMenu->Append(ID_GET_REPORT,_("Report gas details"),_("Show the statistics of the current gas"));
         menuBar->Append(actionsMenu, _("&Actions"));
     }
@@ -365,6 +378,7 @@ MyFrame::MyFrame(const wxString& title)
     
     this->current_gas_type = 6;
     this->gas = LatticeGasFactory::CreateGas(this->current_gas_type);
+    this->renderer = new LatticeGasRenderer(this->gas);
     this->current_demo = 1;
     this->LoadCurrentDemo();
     
@@ -374,8 +388,9 @@ MyFrame::MyFrame(const wxString& title)
 void MyFrame::LoadCurrentDemo()
 {
     this->gas->ResetGridForDemo(this->current_demo);
+    this->renderer->SetDisplayForDemo(this->current_demo);
     this->offset = wxPoint(0,0);
-    this->gas->RequestBestFitZoomFactor(this->GetClientSize().GetWidth(),this->GetClientSize().GetHeight());
+    this->renderer->RequestBestFitZoomFactor(this->GetClientSize().GetWidth(),this->GetClientSize().GetHeight());
     if(this->current_demo==0) this->running_step = 1;
     else this->running_step = 10;
     this->is_running = false;
@@ -384,6 +399,7 @@ void MyFrame::LoadCurrentDemo()
 
 MyFrame::~MyFrame()
 {
+   delete this->renderer;
    delete this->gas;
 }
 
@@ -458,7 +474,7 @@ void MyFrame::OnPaint(wxPaintEvent& /*event*/)
         // BUG: this message doesn't show up on linux, only on Windows
 
         wxPaintDC dc(this);
-        this->gas->Draw(dc,this->offset.x,this->offset.y);
+        this->renderer->Draw(dc,this->offset.x,this->offset.y);
     }
 
     SetStatusText(wxString::Format(_("%d iterations"),this->gas->GetIterations()),0);
@@ -466,7 +482,7 @@ void MyFrame::OnPaint(wxPaintEvent& /*event*/)
     // display the current zoom setting
     {
         int num,denom;
-        this->gas->GetZoom(num,denom);
+        this->renderer->GetZoom(num,denom);
         if(denom==1)
             SetStatusText(wxString::Format(_("Zoom: %d"),num),1);
         else
@@ -516,45 +532,45 @@ void MyFrame::OnRunOrStop(wxCommandEvent& /*event*/)
 
 void MyFrame::OnChangeLineLength(wxCommandEvent& /*event*/)
 {
-    double old_line_length = this->gas->GetLineLength(),new_line_length;
+    double old_line_length = this->renderer->GetLineLength(),new_line_length;
     wxString ret = wxGetTextFromUser(_("Enter the line length:"),_("Line lengths"),
         wxString::Format(_T("%.0f"),old_line_length));
     if(ret.IsEmpty()) return; // user cancelled
     ret.ToDouble(&new_line_length);
     if(new_line_length!=old_line_length) // (double comparison...)
     {
-        this->gas->SetLineLength(new_line_length);
+        this->renderer->SetLineLength(new_line_length);
         this->Refresh(false);
     }
 }
 
 void MyFrame::OnUpdateChangeLineLength(wxUpdateUIEvent& event)
 {
-    event.Enable(this->gas->GetShowFlow());
+    event.Enable(this->renderer->GetShowFlow());
 }
 
 void MyFrame::OnShowFlowColours(wxCommandEvent& /*event*/)
 {
-    this->gas->SetShowFlowColours(!this->gas->GetShowFlowColours());
+    this->renderer->SetShowFlowColours(!this->renderer->GetShowFlowColours());
     this->Refresh(false);
 }
 
 void MyFrame::OnUpdateShowFlowColours(wxUpdateUIEvent& event)
 {
-    event.Enable(this->gas->GetShowFlow());
-    event.Check(this->gas->GetShowFlowColours());
+    event.Enable(this->renderer->GetShowFlow());
+    event.Check(this->renderer->GetShowFlowColours());
 }
 
 void MyFrame::OnShowGrid(wxCommandEvent& /*event*/)
 {
-    this->gas->SetShowGrid(!this->gas->GetShowGrid());
+    this->renderer->SetShowGrid(!this->renderer->GetShowGrid());
     this->Refresh(false);
 }
 
 void MyFrame::OnUpdateShowGrid(wxUpdateUIEvent& event)
 {
-    event.Enable(this->gas->GetShowGas());
-    event.Check(this->gas->GetShowGrid());
+    event.Enable(this->renderer->GetShowGas());
+    event.Check(this->renderer->GetShowGrid());
 }
 
 void MyFrame::OnChangeToVelocityRepresentationN(wxCommandEvent& event)
@@ -565,7 +581,7 @@ void MyFrame::OnChangeToVelocityRepresentationN(wxCommandEvent& event)
 
 void MyFrame::OnUpdateVelocityRepresentationN(wxUpdateUIEvent& event)
 {
-    event.Enable(this->gas->GetShowFlow());
+    event.Enable(this->renderer->GetShowFlow());
     event.Check(event.GetId()-ID_VELOCITY_REPRESENTATION_0 == this->gas->GetVelocityRepresentation());
 }
 
@@ -588,7 +604,7 @@ void MyFrame::OnChangeAveragingRadius(wxCommandEvent& /*event*/)
 
 void MyFrame::OnUpdateChangeAveragingRadius(wxUpdateUIEvent& event)
 {
-    event.Enable(this->gas->GetShowFlow());
+    event.Enable(this->renderer->GetShowFlow());
 }
 
 void MyFrame::OnGettingStarted(wxCommandEvent& /*event*/)
@@ -653,7 +669,7 @@ void MyFrame::OnUpdateDemoN(wxUpdateUIEvent& event)
 
 void MyFrame::OnZoomIn(wxCommandEvent& /*event*/)
 {
-    if(this->gas->ZoomIn())
+    if(this->renderer->ZoomIn())
         this->Refresh(true);
     else
         wxMessageBox(_("Resulting image too large, can't zoom in any further."));
@@ -661,33 +677,35 @@ void MyFrame::OnZoomIn(wxCommandEvent& /*event*/)
 
 void MyFrame::OnZoomOut(wxCommandEvent& /*event*/)
 {
-    this->gas->ZoomOut();
+    this->renderer->ZoomOut();
     this->Refresh(true);
 }
 
 void MyFrame::OnShowFlow(wxCommandEvent& /*event*/)
 {
-    this->gas->SetShowFlow(!this->gas->GetShowFlow());
+    this->renderer->SetShowFlow(!this->renderer->GetShowFlow());
     this->Refresh(true);
 }
 
 void MyFrame::OnUpdateShowFlow(wxUpdateUIEvent& event)
 {
-    event.Check(this->gas->GetShowFlow());
+    event.Check(this->renderer->GetShowFlow());
 }
 
 void MyFrame::OnChangeToGasTypeN(wxCommandEvent& event)
 {
     int new_ID = event.GetId() - ID_GAS_TYPE_0;
-    BaseLatticeGas_drawable* new_gas = LatticeGasFactory::CreateGas(new_ID);
+    BaseLatticeGas* new_gas = LatticeGasFactory::CreateGas(new_ID);
     if(new_gas==NULL) 
     {
         wxMessageBox(_("Gas not yet supported, sorry!"));
         return;
     }
+    delete this->renderer;
     delete this->gas;
     this->current_gas_type = new_ID;
     this->gas = new_gas;
+    this->renderer = new LatticeGasRenderer(this->gas);
     this->LoadCurrentDemo();
 }
 
@@ -697,14 +715,44 @@ void MyFrame::OnUpdateChangeToGasTypeN(wxUpdateUIEvent& event)
     event.Check(is_current);
 }
 
+void MyFrame::OnLoadRuleFile(wxCommandEvent& event)
+{
+    wxFileDialog dlg(this,_("Load gas rules"),wxEmptyString,wxEmptyString,_("Rule files (*.txt)|*.txt|All files|*"),
+        wxFD_OPEN|wxFD_FILE_MUST_EXIST);
+    if(dlg.ShowModal()!=wxID_OK) return;
+    BaseLatticeGas* new_gas;
+    string description;
+    try
+    {
+        new_gas = LatticeGasFactory::CreateGasFromRuleFile(string(dlg.GetPath().mb_str()),description);
+    }
+    catch(const exception& e)
+    {
+        wxMessageBox(wxString(e.what(),wxConvUTF8));
+        return;
+    }
+    delete this->renderer;
+    delete this->gas;
+    this->current_gas_type = -1;
+    this->rule_file_gas_description = wxString(description.c_str(),wxConvUTF8);
+    this->gas = new_gas;
+    this->renderer = new LatticeGasRenderer(this->gas);
+    this->LoadCurrentDemo();
+}
+
 void MyFrame::OnGetReport(wxCommandEvent& event)
 {
     wxString oss;
-    oss << _("Gas type: ") << LatticeGasFactory::GetGasDescription(this->current_gas_type);
+    oss << _("Gas type: ");
+    if(this->current_gas_type<0)
+        oss << this->rule_file_gas_description;
+    else
+        oss << ToWxString(LatticeGasFactory::GetGasDescription(this->current_gas_type));
     oss << _T("\n");
     oss << _("Size: ") << this->gas->GetX() << _T("x") << this->gas->GetY() << _T("\n");
-    oss << _("Number of gas particles: ") << this->gas->GetNumGasParticles() << _T("\n");
-    oss << _("Density: ") << 100.0f*this->gas->GetNumGasParticles()/this->gas->GetMaxNumGasParticles() << _T("%\n");
+    BaseLatticeGas::Statistics stats = this->gas->GetStatistics();
+    oss << _("Number of gas particles: ") << (long)stats.n_gas_particles << _T("\n");
+    oss << _("Density: ") << 100.0f*stats.n_gas_particles/stats.max_num_gas_particles << _T("%\n");
     RealPoint v = this->gas->GetAverageInputFlowVelocityPerParticle();
     oss << _("Average input flow per particle: ") << v.x << _T(",") << v.y << _T("\n");
     RealPoint av = this->gas->GetAverageVelocityPerParticle();
@@ -714,25 +762,25 @@ void MyFrame::OnGetReport(wxCommandEvent& event)
 
 void MyFrame::OnShowGas(wxCommandEvent& event)
 {
-    this->gas->SetShowGas(!this->gas->GetShowGas());
+    this->renderer->SetShowGas(!this->renderer->GetShowGas());
     this->Refresh(true);
 }
 
 void MyFrame::OnUpdateShowGas(wxUpdateUIEvent& event)
 {
-    event.Check(this->gas->GetShowGas());
+    event.Check(this->renderer->GetShowGas());
 }
 
 void MyFrame::OnShowGasColours(wxCommandEvent& event)
 {
-    this->gas->SetShowGasColours(!this->gas->GetShowGasColours());
+    this->renderer->SetShowGasColours(!this->renderer->GetShowGasColours());
     this->Refresh(true);
 }
 
 void MyFrame::OnUpdateShowGasColours(wxUpdateUIEvent& event)
 {
-    event.Enable(this->gas->GetShowGas());
-    event.Check(this->gas->GetShowGasColours());
+    event.Enable(this->renderer->GetShowGas());
+    event.Check(this->renderer->GetShowGasColours());
 }
 
 void MyFrame::OnChangeRedrawStep(wxCommandEvent &event)
@@ -758,7 +806,7 @@ Enter the new redraw step:"),_("Redraw step"),
 void MyFrame::OnFitToWindow(wxCommandEvent& event)
 {
     this->offset = wxPoint(0,0);
-    this->gas->RequestBestFitZoomFactor(this->GetClientSize().GetWidth(),this->GetClientSize().GetHeight());
+    this->renderer->RequestBestFitZoomFactor(this->GetClientSize().GetWidth(),this->GetClientSize().GetHeight());
     this->Refresh(false);
 }
 
@@ -0,0 +1,393 @@
+/*
+    Lattice Gas Explorer
+    Copyright (C) 2008-2009 Tim J. Hutton <tim.hutton@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// A benchmark: times the update of every type of gas on a range of grid sizes (chosen to fit in
+// each level of the cache, and to overflow it), on the demos, and on different numbers of threads,
+// and writes the results as JSON, so that the speed of one version can be compared with another.
+
+// local:
+#include "LatticeGasFactory.h"
+
+// STL:
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <stdexcept>
+#include <exception>
+#include <memory>
+#include <algorithm>
+using namespace std;
+
+// standard library:
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+
+// OpenMP
+#include <omp.h>
+
+static const char *USAGE =
+    "Usage: LatticeGasBenchmark [options]\n"
+    "\n"
+    "  --gas N,N,...           the types of gas to time (see --list) [default: all of them]\n"
+    "  --sizes S,S,...         the grid sizes: L1, L2, L3 or DRAM (a grid that fits in that level of\n"
+    "                          the cache, or is too big for any), or WxH [default: L1,L2,L3,DRAM]\n"
+    "  --demos N,N,...         the demos to time as well, at their own sizes (see --list)\n"
+    "                          [default: all of them]\n"
+    "  --threads N,N,...       the numbers of threads [default: 1,2,4,... up to all the cores]\n"
+    "  --min-time SECONDS      keep each timing going for at least this long [default: 0.5]\n"
+    "  --output FILE           where to write the JSON [default: the standard output]\n"
+    "  --list                  list the gas types and the demos, and exit\n";
+
+struct Options
+{
+    vector<int> gas_types,demos,n_threads;
+    vector<string> sizes;
+    double min_seconds;
+    string output_file;
+
+    Options() : min_seconds(0.5) {}
+};
+
+// one row of the results
+struct Result
+{
+    int gas_type;
+    string gas,geometry;
+    int X,Y,threads;
+    int steps;
+    double seconds,mlups;
+    double bytes_per_update,gigabytes_per_second;
+    double compute_flow_ms,redraw_ms;
+};
+
+static int ToInt(const string& text,const string& option)
+{
+    istringstream iss(text);
+    int i;
+    if(!(iss >> i) || !iss.eof() || i<0)
+        throw runtime_error("expected a whole number for "+option+", not \""+text+"\"");
+    return i;
+}
+
+static vector<string> Split(const string& text)
+{
+    vector<string> items;
+    istringstream iss(text);
+    string item;
+    while(getline(iss,item,','))
+        items.push_back(item);
+    return items;
+}
+
+// the value after option i (moving i on to it)
+static string GetValue(int argc,char *argv[],int &i)
+{
+    if(i+1>=argc)
+        throw runtime_error(string("expected a value after ")+argv[i]);
+    return argv[++i];
+}
+
+static Options ParseOptions(int argc,char *argv[])
+{
+    Options options;
+    for(int type=0;type<LatticeGasFactory::GetNumGasTypesSupported();type++)
+        options.gas_types.push_back(type);
+    for(int demo=0;demo<BaseLatticeGas::GetNumDemos();demo++)
+        options.demos.push_back(demo);
+    options.sizes = Split("L1,L2,L3,DRAM");
+    for(int n=1;n<omp_get_max_threads();n*=2)
+        options.n_threads.push_back(n);
+    options.n_threads.push_back(omp_get_max_threads());
+
+    for(int i=1;i<argc;i++)
+    {
+        const string option = argv[i];
+        if(option=="--help" || option=="-h")
+        {
+            cout << USAGE;
+            exit(EXIT_SUCCESS);
+        }
+        else if(option=="--list")
+        {
+            cout << "Gas types:\n";
+            for(int type=0;type<LatticeGasFactory::GetNumGasTypesSupported();type++)
+                cout << "  " << type << ": " << LatticeGasFactory::GetGasDescription(type) << "\n";
+            cout << "Demos:\n";
+            for(int demo=0;demo<BaseLatticeGas::GetNumDemos();demo++)
+                cout << "  " << demo << ": " << BaseLatticeGas::GetDemoDescription(demo) << "\n";
+            exit(EXIT_SUCCESS);
+        }
+        else if(option=="--sizes") options.sizes = Split(GetValue(argc,argv,i));
+        else if(option=="--output") options.output_file = GetValue(argc,argv,i);
+        else if(option=="--min-time")
+        {
+            istringstream iss(GetValue(argc,argv,i));
+            if(!(iss >> options.min_seconds) || options.min_seconds<0.0)
+                throw runtime_error("expected a number of seconds for "+option);
+        }
+        else if(option=="--gas" || option=="--demos" || option=="--threads")
+        {
+            vector<int> &list = (option=="--gas") ? options.gas_types : (option=="--demos") ? options.demos : options.n_threads;
+            list.clear();
+            const vector<string> items = Split(GetValue(argc,argv,i));
+            for(size_t j=0;j<items.size();j++)
+                list.push_back(ToInt(items[j],option));
+        }
+        else throw runtime_error("unknown option "+option+" (see --help)");
+    }
+
+    for(size_t i=0;i<options.gas_types.size();i++)
+        if(options.gas_types[i]>=LatticeGasFactory::GetNumGasTypesSupported())
+            throw runtime_error("no such gas type (see --list)");
+    for(size_t i=0;i<options.demos.size();i++)
+        if(options.demos[i]>=BaseLatticeGas::GetNumDemos())
+            throw runtime_error("no such demo (see --list)");
+    for(size_t i=0;i<options.n_threads.size();i++)
+        if(options.n_threads[i]<1)
+            throw runtime_error("the numbers of threads must be at least 1");
+    return options;
+}
+
+// the size of level 1, 2 or 3 of the data cache in bytes,
+// from the system where it says, or typical sizes where it doesn't
+static long GetCacheSize(int level)
+{
+    long size = -1;
+#if defined(_SC_LEVEL1_DCACHE_SIZE) && defined(_SC_LEVEL2_CACHE_SIZE) && defined(_SC_LEVEL3_CACHE_SIZE)
+    switch(level)
+    {
+        case 1: size = sysconf(_SC_LEVEL1_DCACHE_SIZE); break;
+        case 2: size = sysconf(_SC_LEVEL2_CACHE_SIZE); break;
+        case 3: size = sysconf(_SC_LEVEL3_CACHE_SIZE); break;
+    }
+#endif
+    if(size>0) return size;
+    switch(level)
+    {
+        case 1: return 32L<<10;
+        case 2: return 1L<<20;
+        default: return 16L<<20;
+    }
+}
+
+// parse a grid size: a level of the cache or WxH (the sizes are rounded to multiples of 64, which
+// suits all the engines)
+static void GetGridSize(const string& size,int &X,int &Y)
+{
+    long n_cells;
+    if(size=="L1" || size=="L2" || size=="L3")
+    {
+        // the two copies of the grid take half the cache (at a byte per cell, as most of the engines)
+        n_cells = GetCacheSize(size[1]-'0') / 4;
+    }
+    else if(size=="DRAM")
+    {
+        // far too big for the last level (and for any we are likely to meet)
+        n_cells = max(4*GetCacheSize(3),128L<<20) / 2;
+    }
+    else
+    {
+        const size_t x = size.find('x');
+        if(x==string::npos)
+            throw runtime_error("expected L1, L2, L3, DRAM or WxH for a size, not \""+size+"\"");
+        X = ToInt(size.substr(0,x),"--sizes");
+        Y = ToInt(size.substr(x+1),"--sizes");
+        if(X%64 || Y%64 || X==0 || Y==0)
+            throw runtime_error("the width and height of a grid must be multiples of 64");
+        return;
+    }
+    // twice as wide as high, like the wind tunnel demos
+    Y = max(64,(int)sqrt(n_cells/2.0)/64*64);
+    X = max(64,(int)(n_cells/Y)/64*64);
+}
+
+static string ToJSON(const string& text)
+{
+    ostringstream oss;
+    oss << '"';
+    for(size_t i=0;i<text.size();i++)
+    {
+        const char c = text[i];
+        if(c=='"' || c=='\\') oss << '\\' << c;
+        else if((unsigned char)c<0x20) oss << "\\u00" << "0123456789abcdef"[c>>4] << "0123456789abcdef"[c&15];
+        else oss << c;
+    }
+    oss << '"';
+    return oss.str();
+}
+
+// (somewhere for the colours to go, so that the compiler can't leave out the redraw)
+static volatile unsigned int redraw_checksum;
+
+// Time the gas as it is: the steps (at least min_seconds of them), then the flow computation and
+// the redraw on their own. The redraw is the part of LatticeGasRenderer's work that depends on the
+// gas - reading every row of cells and looking up their colours - since the wxWidgets drawing
+// that follows is the same for all of them.
+static Result TimeGas(BaseLatticeGas *gas,int n_threads,double min_seconds)
+{
+    omp_set_num_threads(n_threads);
+
+    Result result;
+    result.X = gas->GetX();
+    result.Y = gas->GetY();
+    result.threads = n_threads;
+
+    gas->UpdateGas(); // (a step to warm the cache, and the threads)
+
+    result.steps = 0;
+    const double start = omp_get_wtime();
+    do {
+        gas->UpdateGas();
+        result.steps++;
+        result.seconds = omp_get_wtime()-start;
+    } while(result.seconds<min_seconds || result.steps<3);
+    const double n_updates = (double)result.X*result.Y*result.steps;
+    result.mlups = n_updates/result.seconds/1e6;
+    result.bytes_per_update = 2*gas->GetBytesPerCell();
+    result.gigabytes_per_second = n_updates*result.bytes_per_update/result.seconds/1e9;
+
+    // (each step leaves the flow to be recomputed, and the images to be redrawn)
+    const int N_REPEATS = 3;
+    vector<BaseLatticeGas::state> buffer(result.X);
+    vector<unsigned char> rgb(3*result.X);
+    double flow_seconds = 0.0, redraw_seconds = 0.0;
+    unsigned int checksum = 0;
+    for(int repeat=0;repeat<N_REPEATS;repeat++)
+    {
+        gas->UpdateGas();
+
+        double t = omp_get_wtime();
+        gas->ComputeFlowIfNeeded();
+        flow_seconds += omp_get_wtime()-t;
+
+        t = omp_get_wtime();
+        for(int y=0;y<result.Y;y++)
+        {
+            // (as LatticeGasRenderer draws the gas: showing velocities instead costs the same)
+            gas->GetColoursOfRow(gas->GetStateRow(y,&buffer[0]),y,result.X,false,&rgb[0]);
+            checksum += rgb[3*(y%result.X)];
+        }
+        redraw_seconds += omp_get_wtime()-t;
+    }
+    redraw_checksum = checksum;
+    result.compute_flow_ms = flow_seconds/N_REPEATS*1e3;
+    result.redraw_ms = redraw_seconds/N_REPEATS*1e3;
+    return result;
+}
+
+static void WriteResults(ostream& out,const Options& options,const vector<Result>& results)
+{
+    out << "{\n";
+    out << "  \"program\": \"LatticeGasBenchmark\",\n";
+    out << "  \"max_threads\": " << omp_get_max_threads() << ",\n";
+    out << "  \"cache_bytes\": { \"L1\": " << GetCacheSize(1) << ", \"L2\": " << GetCacheSize(2)
+        << ", \"L3\": " << GetCacheSize(3) << " },\n";
+    out << "  \"min_seconds\": " << options.min_seconds << ",\n";
+    out << "  \"results\": [";
+    for(size_t i=0;i<results.size();i++)
+    {
+        const Result &r = results[i];
+        out << (i>0 ? "," : "") << "\n    { "
+            << "\"gas_type\": " << r.gas_type << ", "
+            << "\"gas\": " << ToJSON(r.gas) << ", "
+            << "\"geometry\": " << ToJSON(r.geometry) << ", "
+            << "\"x\": " << r.X << ", \"y\": " << r.Y << ", "
+            << "\"threads\": " << r.threads << ", "
+            << "\"steps\": " << r.steps << ", "
+            << "\"seconds\": " << r.seconds << ", "
+            << "\"mlups\": " << r.mlups << ", "
+            << "\"bytes_per_update\": " << r.bytes_per_update << ", "
+            << "\"gigabytes_per_second\": " << r.gigabytes_per_second << ", "
+            << "\"compute_flow_ms\": " << r.compute_flow_ms << ", "
+            << "\"redraw_ms\": " << r.redraw_ms << " }";
+    }
+    out << "\n  ]\n}\n";
+}
+
+static void Run(const Options& options)
+{
+    vector<Result> results;
+    for(size_t i=0;i<options.gas_types.size();i++)
+    {
+        const int type = options.gas_types[i];
+        unique_ptr<BaseLatticeGas> gas(LatticeGasFactory::CreateGas(type));
+        if(!gas)
+        {
+            cerr << "Skipping gas type " << type << " (not yet supported)" << endl;
+            continue;
+        }
+        gas->SetRandomSeed(1);
+
+        // the geometries: an empty wind tunnel of each size, and the demos
+        const int n_sizes = (int)options.sizes.size();
+        for(int g=0;g<n_sizes+(int)options.demos.size();g++)
+        {
+            string geometry;
+            if(g<n_sizes)
+            {
+                int X,Y;
+                GetGridSize(options.sizes[g],X,Y);
+                geometry = "tunnel "+options.sizes[g];
+                gas->ResetGridForGeometry(X,Y,vector<bool>((size_t)X*Y,false));
+            }
+            else
+            {
+                const int demo = options.demos[g-n_sizes];
+                geometry = BaseLatticeGas::GetDemoDescription(demo);
+                gas->ResetGridForDemo(demo);
+            }
+            for(size_t t=0;t<options.n_threads.size();t++)
+            {
+                Result result = TimeGas(gas.get(),options.n_threads[t],options.min_seconds);
+                result.gas_type = type;
+                result.gas = LatticeGasFactory::GetGasDescription(type);
+                result.geometry = geometry;
+                cerr << result.gas << ", " << geometry << " (" << result.X << "x" << result.Y << "), "
+                    << result.threads << " threads: " << result.mlups << " MLUPS" << endl;
+                results.push_back(result);
+            }
+        }
+    }
+
+    if(options.output_file.empty())
+        WriteResults(cout,options,results);
+    else
+    {
+        ofstream out(options.output_file.c_str());
+        if(!out)
+            throw runtime_error("failed to open "+options.output_file);
+        WriteResults(out,options,results);
+    }
+}
+
+int main(int argc,char *argv[])
+{
+    try
+    {
+        Run(ParseOptions(argc,argv));
+    }
+    catch(const exception& e)
+    {
+        cerr << "Error: " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
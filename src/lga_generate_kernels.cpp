@@ -0,0 +1,103 @@
+/*
+    Lattice Gas Explorer
+    Copyright (C) 2008-2009 Tim J. Hutton <tim.hutton@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Run as part of the build: compiles the collision rules of each built-in FHP variant into a
+// circuit (see BitSlicedCircuit) and writes it out as straight-line C++, for the bit-plane engine
+// to include (see BitPlaneFHPLatticeGas). Interpreting the circuit at run time works for any rules,
+// but the compiled code is several times faster: the gates then work on registers, not on planes
+// in memory. A new variant only needs adding to the list below.
+//
+// Usage: LatticeGasKernelGenerator FILE (the header to write)
+
+// local:
+#include "FHPLatticeGas.h"
+#include "BitSlicedCircuit.h"
+
+// STL:
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <exception>
+using namespace std;
+
+// standard library:
+#include <stdlib.h>
+
+struct Variant { FHPLatticeGas::FHP_type type; const char *type_name,*function_name; };
+
+static const Variant VARIANTS[] = {
+    { FHPLatticeGas::FHP_I, "FHP_I", "CollideFHP_I" },
+    { FHPLatticeGas::FHP_II, "FHP_II", "CollideFHP_II" },
+    { FHPLatticeGas::FHP_III, "FHP_III", "CollideFHP_III" },
+    { FHPLatticeGas::FHP_6, "FHP_6", "CollideFHP_6" },
+};
+static const int N_VARIANTS = sizeof(VARIANTS)/sizeof(VARIANTS[0]);
+
+static void WriteKernels(ostream& out)
+{
+    out << "// generated by LatticeGasKernelGenerator (see src/lga_generate_kernels.cpp): don't edit\n\n";
+    out << "#ifndef __FHPCOLLISIONKERNELS__\n";
+    out << "#define __FHPCOLLISIONKERNELS__\n\n";
+    out << "#include \"FHPLatticeGas.h\"\n";
+    out << "#include \"BitSlicedCircuit.h\"\n\n";
+    for(int i=0;i<N_VARIANTS;i++)
+    {
+        const FHPLatticeGas gas(VARIANTS[i].type);
+        BitSlicedCircuit circuit;
+        circuit.Compile(9,7,gas.GetCollisionFlipTable());
+        circuit.WriteCode(out,VARIANTS[i].function_name);
+        out << "\n";
+    }
+    out << "typedef void (*FHPCollisionKernel)(const BitSlicedCircuit::word* const*,BitSlicedCircuit::word* const*,int);\n\n";
+    out << "// the collisions of a built-in variant: which bits of the state change (NULL if there is no kernel)\n";
+    out << "static FHPCollisionKernel GetFHPCollisionKernel(FHPLatticeGas::FHP_type type)\n";
+    out << "{\n";
+    out << "    switch(type)\n";
+    out << "    {\n";
+    for(int i=0;i<N_VARIANTS;i++)
+        out << "        case FHPLatticeGas::" << VARIANTS[i].type_name << ": return " << VARIANTS[i].function_name << ";\n";
+    out << "        default: return NULL;\n";
+    out << "    }\n";
+    out << "}\n\n";
+    out << "#endif\n";
+}
+
+int main(int argc,char *argv[])
+{
+    if(argc!=2)
+    {
+        cerr << "Usage: LatticeGasKernelGenerator FILE\n";
+        return EXIT_FAILURE;
+    }
+    try
+    {
+        ofstream out(argv[1]);
+        if(!out)
+            throw runtime_error(string("failed to open ")+argv[1]);
+        WriteKernels(out);
+        if(!out)
+            throw runtime_error(string("failed to write ")+argv[1]);
+    }
+    catch(const exception& e)
+    {
+        cerr << "Error: " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,381 @@
+/*
+    Lattice Gas Explorer
+    Copyright (C) 2008-2009 Tim J. Hutton <tim.hutton@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// A command-line runner, for long simulations with no display: it sets up a gas, advances it as
+// fast as the machine allows, and writes statistics, flow fields and checkpoints to disk as it goes.
+
+// local:
+#include "LatticeGasFactory.h"
+
+// STL:
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <stdexcept>
+#include <exception>
+#include <memory>
+#include <algorithm>
+using namespace std;
+
+// standard library:
+#include <stdio.h>
+#include <stdlib.h>
+
+// OpenMP
+#include <omp.h>
+
+static const char *USAGE =
+    "Usage: LatticeGasRunner [options]\n"
+    "\n"
+    "Setting up:\n"
+    "  --gas N                 the type of gas (see --list) [default: 6]\n"
+    "  --rules FILE            a gas with rules read from a file instead (see GasRules.h)\n"
+    "  --demo N                start from this demo (see --list) [default: 1]\n"
+    "  --geometry FILE         start from a wind tunnel with the obstacles in a PBM image\n"
+    "                          (black is an obstacle; for the pair-interaction gases the width\n"
+    "                          and height must be even)\n"
+    "  --resume FILE           carry on from a checkpoint (made with the same gas)\n"
+    "  --seed N                the random seed [default: 1]\n"
+    "  --list                  list the gas types and the demos, and exit\n"
+    "\n"
+    "Running:\n"
+    "  --steps N               how many steps to take [default: 1000]\n"
+    "  --threads N             how many threads to use [default: all the cores]\n"
+    "  --temporal-blocking R,T advance bands of R rows T steps at a time (see SetTemporalBlocking)\n"
+    "  --in-place              keep only one copy of the grid (see SetInPlaceUpdates)\n"
+    "\n"
+    "Output (the files are named with the iteration number, e.g. flow_001000.csv):\n"
+    "  --stats-every N         write a line of statistics every N steps [default: 100]\n"
+    "  --stats FILE            where to write them [default: stats.csv]\n"
+    "  --flow-every N          write the flow field every N steps [default: 0, never]\n"
+    "  --flow-prefix P         [default: flow_]\n"
+    "  --checkpoint-every N    write a checkpoint every N steps, and at the end [default: 0, never]\n"
+    "  --checkpoint-prefix P   [default: checkpoint_]\n";
+
+struct Options
+{
+    int gas_type,demo;
+    string rules_file,geometry_file,resume_file;
+    unsigned int seed;
+    int n_steps,n_threads;
+    int tile_rows,time_steps;
+    bool in_place;
+    int stats_every,flow_every,checkpoint_every;
+    string stats_file,flow_prefix,checkpoint_prefix;
+
+    Options() : gas_type(6), demo(1), seed(1), n_steps(1000), n_threads(0), tile_rows(0), time_steps(1),
+        in_place(false), stats_every(100), flow_every(0), checkpoint_every(0), stats_file("stats.csv"),
+        flow_prefix("flow_"), checkpoint_prefix("checkpoint_") {}
+};
+
+static int ToInt(const string& text,const string& option)
+{
+    istringstream iss(text);
+    int i;
+    if(!(iss >> i) || !iss.eof() || i<0)
+        throw runtime_error("expected a whole number for "+option+", not \""+text+"\"");
+    return i;
+}
+
+static string GetFilename(const string& prefix,int iteration,const string& extension)
+{
+    ostringstream oss;
+    oss << prefix;
+    oss.width(6);
+    oss.fill('0');
+    oss << iteration << extension;
+    return oss.str();
+}
+
+// the obstacles of a PBM image (plain or raw): black pixels are obstacles
+static vector<bool> ReadPBM(const string& filename,int &width,int &height)
+{
+    ifstream in(filename.c_str(),ios::binary);
+    if(!in)
+        throw runtime_error("failed to open "+filename);
+    string magic;
+    in >> magic;
+    if(magic!="P1" && magic!="P4")
+        throw runtime_error(filename+" isn't a PBM image (P1 or P4)");
+    // (the header may have comments in it)
+    int values[2];
+    for(int i=0;i<2;i++)
+    {
+        in >> ws;
+        while(in.peek()=='#')
+        {
+            string comment;
+            getline(in,comment);
+            in >> ws;
+        }
+        in >> values[i];
+    }
+    width = values[0];
+    height = values[1];
+    if(!in || width<=0 || height<=0)
+        throw runtime_error(filename+" has a bad header");
+    vector<bool> is_obstacle((size_t)width*height);
+    if(magic=="P1")
+    {
+        for(size_t i=0;i<is_obstacle.size();i++)
+        {
+            char c;
+            in >> c;
+            if(c!='0' && c!='1')
+                throw runtime_error(filename+" is damaged");
+            is_obstacle[i] = (c=='1');
+        }
+    }
+    else
+    {
+        in.get(); // (a single whitespace character follows the header)
+        const int bytes_per_row = (width+7)/8;
+        vector<unsigned char> row(bytes_per_row);
+        for(int y=0;y<height;y++)
+        {
+            in.read((char*)&row[0],bytes_per_row);
+            for(int x=0;x<width;x++)
+                is_obstacle[(size_t)y*width+x] = (row[x/8]>>(7-x%8))&1;
+        }
+    }
+    if(!in)
+        throw runtime_error(filename+" is too short");
+    return is_obstacle;
+}
+
+static void WriteStatisticsHeader(ostream& out)
+{
+    out << "iteration,n_gas_particles,density,momentum_x,momentum_y,velocity_x,velocity_y,seconds,mlups\n";
+}
+
+static void WriteStatistics(ostream& out,BaseLatticeGas *gas,double seconds,double mlups)
+{
+    const BaseLatticeGas::Statistics stats = gas->GetStatistics();
+    // (the mean velocity over the whole grid, rather than over the flow's sample windows)
+    RealPoint v;
+    if(stats.n_gas_particles>0)
+        v = RealPoint(stats.momentum.x/stats.n_gas_particles,stats.momentum.y/stats.n_gas_particles);
+    out << gas->GetIterations() << "," << stats.n_gas_particles << ","
+        << (stats.max_num_gas_particles>0 ? (double)stats.n_gas_particles/stats.max_num_gas_particles : 0.0) << ","
+        << stats.momentum.x << "," << stats.momentum.y << "," << v.x << "," << v.y << ","
+        << seconds << "," << mlups << "\n";
+    out.flush();
+}
+
+static void WriteFlow(const string& filename,BaseLatticeGas *gas)
+{
+    ofstream out(filename.c_str());
+    if(!out)
+        throw runtime_error("failed to open "+filename);
+    gas->ComputeFlowIfNeeded();
+    const int S = gas->GetFlowSampleSeparation();
+    out << "x,y,velocity_x,velocity_y,averaged_velocity_x,averaged_velocity_y\n";
+    for(int y=S;y<gas->GetY()-S;y+=S)
+    {
+        for(int x=S;x<gas->GetX()-S;x+=S)
+        {
+            const RealPoint v = gas->GetFlow(x/S,y/S);
+            const RealPoint av = gas->GetAveragedFlow(x/S,y/S);
+            out << x << "," << y << "," << v.x << "," << v.y << "," << av.x << "," << av.y << "\n";
+        }
+    }
+}
+
+static void WriteCheckpoint(const string& filename,BaseLatticeGas *gas)
+{
+    // (written under another name first, so that a run that is stopped halfway doesn't leave a broken checkpoint)
+    const string temp_filename = filename+".part";
+    {
+        ofstream out(temp_filename.c_str(),ios::binary);
+        if(!out)
+            throw runtime_error("failed to open "+temp_filename);
+        gas->SaveCheckpoint(out);
+    }
+    remove(filename.c_str());
+    if(rename(temp_filename.c_str(),filename.c_str())!=0)
+        throw runtime_error("failed to rename "+temp_filename+" as "+filename);
+}
+
+// the value after option i (moving i on to it)
+static string GetValue(int argc,char *argv[],int &i)
+{
+    if(i+1>=argc)
+        throw runtime_error(string("expected a value after ")+argv[i]);
+    return argv[++i];
+}
+
+static Options ParseOptions(int argc,char *argv[])
+{
+    Options options;
+    for(int i=1;i<argc;i++)
+    {
+        const string option = argv[i];
+        if(option=="--help" || option=="-h")
+        {
+            cout << USAGE;
+            exit(EXIT_SUCCESS);
+        }
+        else if(option=="--list")
+        {
+            cout << "Gas types:\n";
+            for(int type=0;type<LatticeGasFactory::GetNumGasTypesSupported();type++)
+                cout << "  " << type << ": " << LatticeGasFactory::GetGasDescription(type) << "\n";
+            cout << "Demos:\n";
+            for(int demo=0;demo<BaseLatticeGas::GetNumDemos();demo++)
+                cout << "  " << demo << ": " << BaseLatticeGas::GetDemoDescription(demo) << "\n";
+            exit(EXIT_SUCCESS);
+        }
+        else if(option=="--in-place") options.in_place = true;
+        else if(option=="--gas") options.gas_type = ToInt(GetValue(argc,argv,i),option);
+        else if(option=="--rules") options.rules_file = GetValue(argc,argv,i);
+        else if(option=="--demo") options.demo = ToInt(GetValue(argc,argv,i),option);
+        else if(option=="--geometry") options.geometry_file = GetValue(argc,argv,i);
+        else if(option=="--resume") options.resume_file = GetValue(argc,argv,i);
+        else if(option=="--seed") options.seed = (unsigned int)ToInt(GetValue(argc,argv,i),option);
+        else if(option=="--steps") options.n_steps = ToInt(GetValue(argc,argv,i),option);
+        else if(option=="--threads") options.n_threads = ToInt(GetValue(argc,argv,i),option);
+        else if(option=="--temporal-blocking")
+        {
+            const string value = GetValue(argc,argv,i);
+            const size_t comma = value.find(',');
+            if(comma==string::npos)
+                throw runtime_error("expected --temporal-blocking ROWS,STEPS");
+            options.tile_rows = ToInt(value.substr(0,comma),option);
+            options.time_steps = ToInt(value.substr(comma+1),option);
+        }
+        else if(option=="--stats-every") options.stats_every = ToInt(GetValue(argc,argv,i),option);
+        else if(option=="--stats") options.stats_file = GetValue(argc,argv,i);
+        else if(option=="--flow-every") options.flow_every = ToInt(GetValue(argc,argv,i),option);
+        else if(option=="--flow-prefix") options.flow_prefix = GetValue(argc,argv,i);
+        else if(option=="--checkpoint-every") options.checkpoint_every = ToInt(GetValue(argc,argv,i),option);
+        else if(option=="--checkpoint-prefix") options.checkpoint_prefix = GetValue(argc,argv,i);
+        else throw runtime_error("unknown option "+option+" (see --help)");
+    }
+    return options;
+}
+
+static BaseLatticeGas* CreateGas(const Options& options,string& description)
+{
+    unique_ptr<BaseLatticeGas> gas; // (so that it is deleted if setting it up fails)
+    if(!options.rules_file.empty())
+        gas.reset(LatticeGasFactory::CreateGasFromRuleFile(options.rules_file,description));
+    else
+    {
+        if(options.gas_type>=LatticeGasFactory::GetNumGasTypesSupported())
+            throw runtime_error("no such gas type (see --list)");
+        gas.reset(LatticeGasFactory::CreateGas(options.gas_type));
+        if(!gas)
+            throw runtime_error("that gas type is not yet supported");
+        description = LatticeGasFactory::GetGasDescription(options.gas_type);
+    }
+    gas->SetRandomSeed(options.seed);
+    gas->SetInPlaceUpdates(options.in_place);
+    gas->SetTemporalBlocking(options.tile_rows,options.time_steps);
+
+    if(!options.resume_file.empty())
+    {
+        ifstream in(options.resume_file.c_str(),ios::binary);
+        if(!in)
+            throw runtime_error("failed to open "+options.resume_file);
+        gas->LoadCheckpoint(in);
+    }
+    else if(!options.geometry_file.empty())
+    {
+        int width,height;
+        const vector<bool> is_obstacle = ReadPBM(options.geometry_file,width,height);
+        gas->ResetGridForGeometry(width,height,is_obstacle);
+    }
+    else
+    {
+        if(options.demo>=BaseLatticeGas::GetNumDemos())
+            throw runtime_error("no such demo (see --list)");
+        gas->ResetGridForDemo(options.demo);
+    }
+    return gas.release();
+}
+
+static void Run(const Options& options)
+{
+    if(options.n_threads>0)
+        omp_set_num_threads(options.n_threads);
+
+    string description;
+    unique_ptr<BaseLatticeGas> gas(CreateGas(options,description));
+    cout << description << ", " << gas->GetX() << "x" << gas->GetY() << ", from iteration " << gas->GetIterations()
+        << ", " << options.n_steps << " steps on " << omp_get_max_threads() << " threads" << endl;
+
+    ofstream stats;
+    if(options.stats_every>0)
+    {
+        // (carrying on from a checkpoint adds to the statistics that are there, if any)
+        const bool append = !options.resume_file.empty() && ifstream(options.stats_file.c_str()).peek()!=EOF;
+        stats.open(options.stats_file.c_str(),append ? ios::app : ios::out);
+        if(!stats)
+            throw runtime_error("failed to open "+options.stats_file);
+        if(!append)
+            WriteStatisticsHeader(stats);
+        WriteStatistics(stats,gas.get(),0.0,0.0);
+    }
+
+    // advance to each point where something is due to be written, in one go
+    const int end = gas->GetIterations() + options.n_steps;
+    const int everies[3] = { options.stats_every, options.flow_every, options.checkpoint_every };
+    double total_seconds = 0.0;
+    while(gas->GetIterations()<end)
+    {
+        const int it = gas->GetIterations();
+        int next = end;
+        for(int i=0;i<3;i++)
+            if(everies[i]>0)
+                next = min(next,(it/everies[i]+1)*everies[i]);
+
+        const double start = omp_get_wtime();
+        gas->AdvanceGas(next-it);
+        const double seconds = omp_get_wtime()-start;
+        total_seconds += seconds;
+        const double mlups = seconds>0.0 ? (double)gas->GetX()*gas->GetY()*(next-it)/seconds/1e6 : 0.0;
+
+        if(options.stats_every>0 && (next%options.stats_every==0 || next==end))
+            WriteStatistics(stats,gas.get(),seconds,mlups);
+        if(options.flow_every>0 && next%options.flow_every==0)
+            WriteFlow(GetFilename(options.flow_prefix,next,".csv"),gas.get());
+        if(options.checkpoint_every>0 && (next%options.checkpoint_every==0 || next==end))
+            WriteCheckpoint(GetFilename(options.checkpoint_prefix,next,".chk"),gas.get());
+    }
+
+    cout << "Done: " << options.n_steps << " steps in " << total_seconds << "s";
+    if(total_seconds>0.0)
+        cout << " (" << (double)gas->GetX()*gas->GetY()*options.n_steps/total_seconds/1e6 << " MLUPS)";
+    cout << endl;
+}
+
+int main(int argc,char *argv[])
+{
+    try
+    {
+        Run(ParseOptions(argc,argv));
+    }
+    catch(const exception& e)
+    {
+        cerr << "Error: " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
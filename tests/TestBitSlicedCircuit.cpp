@@ -0,0 +1,181 @@
+/*
+    Lattice Gas Explorer
+    Copyright (C) 2008-2009 Tim J. Hutton <tim.hutton@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Checks the compiled collision circuits against the collision tables they were made from: for
+// every built-in FHP variant, each of the 128 states with each of the 4 collision choices (the 512
+// inputs of the circuit) must come out as collision_maps says, both from the kernel generated when
+// building and from the circuit interpreted. Then does the same for some random
+// truth tables, to exercise the minimization on functions that aren't as regular as the gases'.
+
+// local:
+#include "BitPlaneFHPLatticeGas.h"
+#include "BitSlicedCircuit.h"
+
+// STL:
+#include <vector>
+#include <stdexcept>
+#include <iostream>
+#include <functional>
+using namespace std;
+
+// standard library:
+#include <stdlib.h>
+
+typedef BitSlicedCircuit::word word;
+
+// apply a function of n_in bits with n_out bits (evaluated as BitSlicedCircuit::Evaluate would be, on 
+// n_words words of each plane) to every one of its inputs at once, returning the outputs as a truth table
+typedef function<void(const word* const*,word* const*,int)> Evaluator;
+vector<unsigned int> EvaluateAll(int n_in,int n_out,const Evaluator& evaluate)
+{
+    const unsigned int n = 1u<<n_in;
+    const int n_words = (int)((n+63)/64);
+    const int padded = BitSlicedCircuit::GetPaddedSize(n_words);
+    vector< vector<word> > in(n_in,vector<word>(padded,0)),out(n_out,vector<word>(padded,0));
+    vector<const word*> inputs;
+    vector<word*> outputs;
+    for(int k=0;k<n_in;k++)
+    {
+        for(unsigned int i=0;i<n;i++)
+            if(i&(1u<<k))
+                in[k][i/64] |= (word)1<<(i%64);
+        inputs.push_back(&in[k][0]);
+    }
+    for(int j=0;j<n_out;j++)
+        outputs.push_back(&out[j][0]);
+    evaluate(&inputs[0],&outputs[0],n_words);
+
+    vector<unsigned int> result(n,0);
+    for(unsigned int i=0;i<n;i++)
+        for(int j=0;j<n_out;j++)
+            if((out[j][i/64]>>(i%64))&1)
+                result[i] |= 1u<<j;
+    return result;
+}
+
+vector<unsigned int> EvaluateAll(const BitSlicedCircuit& circuit)
+{
+    vector<word> scratch;
+    return EvaluateAll(circuit.GetNumInputs(),circuit.GetNumOutputs(),
+        [&](const word* const* inputs,word* const* outputs,int n_words) { circuit.Evaluate(inputs,outputs,n_words,scratch); });
+}
+
+// (to get at the collisions and the collision tables)
+class TestGas : public BitPlaneFHPLatticeGas
+{
+    public:
+
+        TestGas(FHP_type type) : BitPlaneFHPLatticeGas(type) {}
+
+        // the number of inputs where the engine's collisions (the kernel generated when building, see
+        // lga_generate_kernels.cpp) disagree with collision_maps
+        int CountKernelMismatches() const
+        {
+            vector<word> scratch;
+            return CountMismatches(EvaluateAll(9,7,[&](const word* const* inputs,word* const* outputs,int n_words)
+                { ApplyCollisions(inputs,outputs,n_words,scratch); }));
+        }
+
+        // the same, for the circuit compiled now and interpreted
+        int CountCircuitMismatches() const
+        {
+            BitSlicedCircuit circuit;
+            circuit.Compile(9,7,GetCollisionFlipTable());
+            return CountMismatches(EvaluateAll(circuit));
+        }
+
+    protected:
+
+        int CountMismatches(const vector<unsigned int>& flips) const
+        {
+            int n_mismatches = 0;
+            for(int choice=0;choice<N_COLLISION_CHOICES;choice++)
+                for(int s=0;s<128;s++)
+                    if((s ^ flips[choice*128+s]) != this->collision_maps[choice][s])
+                        n_mismatches++;
+            return n_mismatches;
+        }
+};
+
+int main()
+{
+    int n_failures = 0;
+
+    const FHPLatticeGas::FHP_type types[] = { FHPLatticeGas::FHP_I, FHPLatticeGas::FHP_II,
+        FHPLatticeGas::FHP_III, FHPLatticeGas::FHP_6 };
+    const char* names[] = { "FHP-I", "FHP-II", "FHP-III", "FHP6" };
+    for(int i=0;i<4;i++)
+    {
+        try
+        {
+            TestGas gas(types[i]);
+            const int n_kernel_mismatches = gas.CountKernelMismatches();
+            if(n_kernel_mismatches>0)
+            {
+                cout << names[i] << ": the kernel differs from the collision table for " << n_kernel_mismatches << " inputs\n";
+                n_failures++;
+            }
+            const int n_circuit_mismatches = gas.CountCircuitMismatches();
+            if(n_circuit_mismatches>0)
+            {
+                cout << names[i] << ": the circuit differs from the collision table for " << n_circuit_mismatches << " inputs\n";
+                n_failures++;
+            }
+        }
+        catch(const exception& e)
+        {
+            cout << names[i] << ": " << e.what() << "\n";
+            n_failures++;
+        }
+    }
+
+    srand(1);
+    for(int n_inputs=1;n_inputs<=10;n_inputs++)
+    {
+        for(int trial=0;trial<10;trial++)
+        {
+            const int n_outputs = 1 + rand()%8;
+            vector<unsigned int> truth_table(1u<<n_inputs);
+            for(unsigned int i=0;i<truth_table.size();i++)
+                truth_table[i] = rand() & ((1u<<n_outputs)-1);
+            try
+            {
+                BitSlicedCircuit circuit;
+                circuit.Compile(n_inputs,n_outputs,truth_table);
+                if(EvaluateAll(circuit)!=truth_table || !circuit.Matches(truth_table))
+                {
+                    cout << "random function of " << n_inputs << " inputs (trial " << trial << "): wrong outputs\n";
+                    n_failures++;
+                }
+            }
+            catch(const exception& e)
+            {
+                cout << "random function of " << n_inputs << " inputs (trial " << trial << "): " << e.what() << "\n";
+                n_failures++;
+            }
+        }
+    }
+
+    if(n_failures>0)
+    {
+        cout << n_failures << " failures\n";
+        return EXIT_FAILURE;
+    }
+    cout << "all the circuits match their truth tables\n";
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,216 @@
+/*
+    Lattice Gas Explorer
+    Copyright (C) 2008-2009 Tim J. Hutton <tim.hutton@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Runs gases for a few hundred steps from a fixed seed, and checks that the different ways of
+// getting to the same place agree, checkpoint for checkpoint, or that what should be conserved is.
+//
+// Usage: TestLatticeGases TEST [TYPE...] (the types of gas to test, see LatticeGasFactory::CreateGas)
+//
+//   engines A B [A B...]      gas B ends up the same as gas A (the same rules on another engine)
+//   threads [TYPE...]         four threads end up the same as one [default: every type]
+//   temporal-blocking [TYPE...]  temporal blocking ends up the same as plain updates [default: every type]
+//   in-place [TYPE...]        in-place updates end up the same as two buffers [default: every type]
+//   conservation TYPE...      on a grid with no walls and no forcing, the number of particles and the
+//                             momentum don't change
+
+// local:
+#include "LatticeGasFactory.h"
+
+// STL:
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iostream>
+#include <stdexcept>
+#include <memory>
+using namespace std;
+
+// standard library:
+#include <stdlib.h>
+#include <math.h>
+
+// OpenMP
+#include <omp.h>
+
+static const unsigned int SEED = 12345;
+static const int N_STEPS = 300;
+
+// the demos to run each gas on: a few particles in a box, and a wind tunnel with an obstacle
+static const int DEMOS[] = { BaseLatticeGas::Demo_Particles, BaseLatticeGas::Demo_Obstacle };
+static const int N_DEMOS = 2;
+
+// how to get from the start of a demo to step N_STEPS
+struct Method
+{
+    string name;
+    int n_threads;
+    bool in_place;
+    int tile_rows,time_steps; // (see SetTemporalBlocking)
+};
+
+static const Method PLAIN = { "one thread", 1, false, 0, 1 };
+
+static int n_failures = 0;
+
+// (demo is -1 if the gas wasn't started from a demo)
+static void Fail(int type,int demo,const string& message)
+{
+    cout << LatticeGasFactory::GetGasDescription(type);
+    if(demo>=0)
+        cout << ", demo " << demo;
+    cout << ": " << message << "\n";
+    n_failures++;
+}
+
+// the checkpoint of gas type after N_STEPS steps of a demo (empty if the type isn't supported)
+static string Run(int type,int demo,const Method& method)
+{
+    omp_set_num_threads(method.n_threads);
+    unique_ptr<BaseLatticeGas> gas(LatticeGasFactory::CreateGas(type));
+    if(!gas)
+        return string();
+    gas->SetRandomSeed(SEED);
+    gas->SetInPlaceUpdates(method.in_place);
+    gas->SetTemporalBlocking(method.tile_rows,method.time_steps);
+    gas->ResetGridForDemo(demo);
+    gas->AdvanceGas(N_STEPS);
+    ostringstream out(ios::binary);
+    gas->SaveCheckpoint(out);
+    return out.str();
+}
+
+static void TestEnginesAgree(int type_a,int type_b)
+{
+    for(int iDemo=0;iDemo<N_DEMOS;iDemo++)
+        if(Run(type_b,DEMOS[iDemo],PLAIN)!=Run(type_a,DEMOS[iDemo],PLAIN))
+            Fail(type_b,DEMOS[iDemo],"differs from "+LatticeGasFactory::GetGasDescription(type_a));
+}
+
+static void TestMethodAgrees(int type,const Method& method)
+{
+    for(int iDemo=0;iDemo<N_DEMOS;iDemo++)
+    {
+        const string expected = Run(type,DEMOS[iDemo],PLAIN);
+        if(!expected.empty() && Run(type,DEMOS[iDemo],method)!=expected)
+            Fail(type,DEMOS[iDemo],method.name+" differs from one thread");
+    }
+}
+
+static void TestConservation(int type)
+{
+    omp_set_num_threads(4);
+    unique_ptr<BaseLatticeGas> gas(LatticeGasFactory::CreateGas(type));
+    if(!gas)
+        throw runtime_error("TestConservation : gas type not supported");
+    gas->SetRandomSeed(SEED);
+    // (a strong flow that wraps around, with nothing to change the totals)
+    const int X = 256, Y = 128;
+    gas->ResetGridForGeometry(X,Y,vector<bool>(X*Y,false),false);
+
+    const BaseLatticeGas::Statistics before = gas->GetStatistics();
+    if(before.n_gas_particles==0)
+        Fail(type,-1,"has no particles to test with");
+    gas->AdvanceGas(N_STEPS);
+    const BaseLatticeGas::Statistics after = gas->GetStatistics();
+
+    if(after.n_gas_particles!=before.n_gas_particles)
+        Fail(type,-1,"the number of particles changed");
+    // (the momentum is a sum of doubles, so it is only the same to within rounding)
+    const double tolerance = 1e-9*before.n_gas_particles;
+    if(fabs(after.momentum.x-before.momentum.x)>tolerance || fabs(after.momentum.y-before.momentum.y)>tolerance)
+    {
+        ostringstream oss;
+        oss << "the momentum changed from " << before.momentum.x << "," << before.momentum.y
+            << " to " << after.momentum.x << "," << after.momentum.y;
+        Fail(type,-1,oss.str());
+    }
+}
+
+// the types of gas given on the command line from argv[first], or every type if there are none
+static vector<int> GetTypes(int argc,char *argv[],int first)
+{
+    vector<int> types;
+    for(int i=first;i<argc;i++)
+    {
+        char *end;
+        const long type = strtol(argv[i],&end,10);
+        if(*end!='\0' || type<0 || type>=LatticeGasFactory::GetNumGasTypesSupported())
+            throw runtime_error(string("no such gas type: ")+argv[i]);
+        types.push_back((int)type);
+    }
+    if(types.empty())
+        for(int type=0;type<LatticeGasFactory::GetNumGasTypesSupported();type++)
+            types.push_back(type);
+    return types;
+}
+
+int main(int argc,char *argv[])
+{
+    try
+    {
+        const string test = (argc>1) ? argv[1] : "";
+        const vector<int> types = GetTypes(argc,argv,2);
+        if(test=="engines")
+        {
+            if(argc<4 || types.size()%2!=0)
+                throw runtime_error("expected pairs of gas types");
+            for(size_t i=0;i<types.size();i+=2)
+                TestEnginesAgree(types[i],types[i+1]);
+        }
+        else if(test=="threads")
+        {
+            const Method method = { "four threads", 4, false, 0, 1 };
+            for(size_t i=0;i<types.size();i++)
+                TestMethodAgrees(types[i],method);
+        }
+        else if(test=="temporal-blocking")
+        {
+            const Method method = { "temporal blocking", 4, false, 16, 4 };
+            for(size_t i=0;i<types.size();i++)
+                TestMethodAgrees(types[i],method);
+        }
+        else if(test=="in-place")
+        {
+            const Method method = { "in-place updates", 4, true, 0, 1 };
+            for(size_t i=0;i<types.size();i++)
+                TestMethodAgrees(types[i],method);
+        }
+        else if(test=="conservation")
+        {
+            if(argc<3)
+                throw runtime_error("expected the gas types");
+            for(size_t i=0;i<types.size();i++)
+                TestConservation(types[i]);
+        }
+        else
+            throw runtime_error("Usage: TestLatticeGases engines|threads|temporal-blocking|in-place|conservation [TYPE...]");
+    }
+    catch(const exception& e)
+    {
+        cout << "Error: " << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    if(n_failures>0)
+    {
+        cout << n_failures << " failures\n";
+        return EXIT_FAILURE;
+    }
+    cout << "passed\n";
+    return EXIT_SUCCESS;
+}